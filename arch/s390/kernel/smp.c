@@ -541,9 +541,7 @@ int __cpuinit start_secondary(void *cpuvoid)
 	pfault_init();
 
 	notify_cpu_starting(smp_processor_id());
-	ipi_call_lock();
 	set_cpu_online(smp_processor_id(), true);
-	ipi_call_unlock();
 	__ctl_clear_bit(0, 28); /* Disable lowcore protection */
 	S390_lowcore.restart_psw.mask =
 		PSW_DEFAULT_KEY | PSW_MASK_BASE | PSW_MASK_EA | PSW_MASK_BA;
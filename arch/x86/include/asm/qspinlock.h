@@ -0,0 +1,24 @@
+#ifndef _ASM_X86_QSPINLOCK_H
+#define _ASM_X86_QSPINLOCK_H
+
+#include <asm-generic/qspinlock_types.h>
+
+#if !(defined(CONFIG_X86_32) && \
+      (defined(CONFIG_X86_OOSTORE) || defined(CONFIG_X86_PPRO_FENCE)))
+/*
+ * The locked byte is the least significant byte of the lock word and
+ * stores are not reordered with older loads or stores, so a plain byte
+ * store releases the lock.  PPro and OOSTORE need the locked operation
+ * of the generic version (PPro errata 66, 92).
+ */
+#define queued_spin_unlock queued_spin_unlock
+static inline void queued_spin_unlock(struct qspinlock *lock)
+{
+	barrier();
+	ACCESS_ONCE(*(u8 *)lock) = 0;
+}
+#endif
+
+#include <asm-generic/qspinlock.h>
+
+#endif /* _ASM_X86_QSPINLOCK_H */
@@ -71,13 +71,10 @@ static struct platform_device *dummy;
 static struct ramoops_platform_data *dummy_data;
 
 static void ramoops_do_dump(struct kmsg_dumper *dumper,
-		enum kmsg_dump_reason reason, const char *s1, unsigned long l1,
-		const char *s2, unsigned long l2)
+		enum kmsg_dump_reason reason)
 {
 	struct ramoops_context *cxt = container_of(dumper,
 			struct ramoops_context, dump);
-	unsigned long s1_start, s2_start;
-	unsigned long l1_cpy, l2_cpy;
 	int res, hdr_size;
 	char *buf, *buf_orig;
 	struct timeval timestamp;
@@ -101,14 +98,8 @@ static void ramoops_do_dump(struct kmsg_dumper *dumper,
 	buf += res;
 
 	hdr_size = buf - buf_orig;
-	l2_cpy = min(l2, cxt->record_size - hdr_size);
-	l1_cpy = min(l1, cxt->record_size - hdr_size - l2_cpy);
-
-	s2_start = l2 - l2_cpy;
-	s1_start = l1 - l1_cpy;
-
-	memcpy(buf, s1 + s1_start, l1_cpy);
-	memcpy(buf + l1_cpy, s2 + s2_start, l2_cpy);
+	kmsg_dump_get_buffer(dumper, true, buf, cxt->record_size - hdr_size,
+			     NULL);
 
 	cxt->count = (cxt->count + 1) % cxt->max_count;
 }
@@ -178,13 +178,25 @@ static void queue_req(struct addr_req *req)
 	mutex_unlock(&lock);
 }
 
-static int dst_fetch_ha(struct dst_entry *dst, struct rdma_dev_addr *addr)
+static int dst_fetch_ha(struct dst_entry *dst, struct rdma_dev_addr *addr,
+			const void *daddr)
 {
 	struct neighbour *n;
 	int ret;
 
 	rcu_read_lock();
 	n = dst_get_neighbour_noref(dst);
+	if (n)
+		neigh_hold(n);
+	rcu_read_unlock();
+
+	/* Shared routes of on-link nexthops carry no neighbour */
+	if (!n && daddr) {
+		n = dst_neigh_lookup(dst, daddr);
+		if (IS_ERR(n))
+			return PTR_ERR(n);
+	}
+
 	if (!n || !(n->nud_state & NUD_VALID)) {
 		if (n)
 			neigh_event_send(n, NULL);
@@ -192,8 +204,9 @@ static int dst_fetch_ha(struct dst_entry *dst, struct rdma_dev_addr *addr)
 	} else {
 		ret = rdma_copy_addr(addr, dst->dev, n->ha);
 	}
-	rcu_read_unlock();
 
+	if (n)
+		neigh_release(n);
 	return ret;
 }
 
@@ -203,6 +216,7 @@ static int addr4_resolve(struct sockaddr_in *src_in,
 {
 	__be32 src_ip = src_in->sin_addr.s_addr;
 	__be32 dst_ip = dst_in->sin_addr.s_addr;
+	__be32 nexthop;
 	struct rtable *rt;
 	struct flowi4 fl4;
 	int ret;
@@ -232,7 +246,8 @@ static int addr4_resolve(struct sockaddr_in *src_in,
 		goto put;
 	}
 
-	ret = dst_fetch_ha(&rt->dst, addr);
+	nexthop = rt_nexthop(rt, dst_ip);
+	ret = dst_fetch_ha(&rt->dst, addr, &nexthop);
 put:
 	ip_rt_put(rt);
 out:
@@ -280,7 +295,7 @@ static int addr6_resolve(struct sockaddr_in6 *src_in,
 		goto put;
 	}
 
-	ret = dst_fetch_ha(dst, addr);
+	ret = dst_fetch_ha(dst, addr, NULL);
 put:
 	dst_release(dst);
 	return ret;
@@ -1342,6 +1342,7 @@ static int pass_accept_req(struct t3cdev *tdev, struct sk_buff *skb, void *ctx)
 	struct l2t_entry *l2t;
 	struct rtable *rt;
 	struct iff_mac tim;
+	__be32 nexthop;
 
 	PDBG("%s parent ep %p tid %u\n", __func__, parent_ep, hwtid);
 
@@ -1374,7 +1375,8 @@ static int pass_accept_req(struct t3cdev *tdev, struct sk_buff *skb, void *ctx)
 		goto reject;
 	}
 	dst = &rt->dst;
-	l2t = t3_l2t_get(tdev, dst, NULL);
+	nexthop = rt_nexthop(rt, req->peer_ip);
+	l2t = t3_l2t_get(tdev, dst, NULL, &nexthop);
 	if (!l2t) {
 		printk(KERN_ERR MOD "%s - failed to allocate l2t entry!\n",
 		       __func__);
@@ -1887,6 +1889,7 @@ int iwch_connect(struct iw_cm_id *cm_id, struct iw_cm_conn_param *conn_param)
 	struct iwch_dev *h = to_iwch_dev(cm_id->device);
 	struct iwch_ep *ep;
 	struct rtable *rt;
+	__be32 nexthop;
 	int err = 0;
 
 	if (is_loopback_dst(cm_id)) {
@@ -1942,7 +1945,8 @@ int iwch_connect(struct iw_cm_id *cm_id, struct iw_cm_conn_param *conn_param)
 		goto fail3;
 	}
 	ep->dst = &rt->dst;
-	ep->l2t = t3_l2t_get(ep->com.tdev, ep->dst, NULL);
+	nexthop = rt_nexthop(rt, cm_id->remote_addr.sin_addr.s_addr);
+	ep->l2t = t3_l2t_get(ep->com.tdev, ep->dst, NULL, &nexthop);
 	if (!ep->l2t) {
 		printk(KERN_ERR MOD "%s - cannot alloc l2e.\n", __func__);
 		err = -ENOMEM;
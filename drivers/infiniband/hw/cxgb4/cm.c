@@ -1559,14 +1559,13 @@ static void get_4tuple(struct cpl_pass_accept_req *req,
 static int import_ep(struct c4iw_ep *ep, __be32 peer_ip, struct dst_entry *dst,
 		     struct c4iw_dev *cdev, bool clear_mpa_v1)
 {
+	__be32 nexthop = rt_nexthop((struct rtable *)dst, peer_ip);
 	struct neighbour *n;
 	int err, step;
 
-	rcu_read_lock();
-	n = dst_get_neighbour_noref(dst);
-	err = -ENODEV;
-	if (!n)
-		goto out;
+	n = dst_neigh_lookup(dst, &nexthop);
+	if (IS_ERR(n))
+		return -ENODEV;
 	err = -ENOMEM;
 	if (n->dev->flags & IFF_LOOPBACK) {
 		struct net_device *pdev;
@@ -1612,7 +1611,7 @@ static int import_ep(struct c4iw_ep *ep, __be32 peer_ip, struct dst_entry *dst,
 	}
 	err = 0;
 out:
-	rcu_read_unlock();
+	neigh_release(n);
 
 	return err;
 }
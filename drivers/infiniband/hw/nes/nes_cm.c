@@ -1338,6 +1338,7 @@ static int nes_addr_resolve_neigh(struct nes_vnic *nesvnic, u32 dst_ip, int arpi
 	int rc = arpindex;
 	struct net_device *netdev;
 	struct nes_adapter *nesadapter = nesvnic->nesdev->nesadapter;
+	__be32 nexthop;
 
 	rt = ip_route_output(&init_net, htonl(dst_ip), 0, 0, 0);
 	if (IS_ERR(rt)) {
@@ -1351,13 +1352,15 @@ static int nes_addr_resolve_neigh(struct nes_vnic *nesvnic, u32 dst_ip, int arpi
 	else
 		netdev = nesvnic->netdev;
 
-	rcu_read_lock();
-	neigh = dst_get_neighbour_noref(&rt->dst);
+	nexthop = rt_nexthop(rt, htonl(dst_ip));
+	neigh = dst_neigh_lookup(&rt->dst, &nexthop);
+	if (IS_ERR(neigh))
+		neigh = NULL;
 	if (neigh) {
 		if (neigh->nud_state & NUD_VALID) {
 			nes_debug(NES_DBG_CM, "Neighbor MAC address for 0x%08X"
 				  " is %pM, Gateway is 0x%08X \n", dst_ip,
-				  neigh->ha, ntohl(rt->rt_gateway));
+				  neigh->ha, ntohl(nexthop));
 
 			if (arpindex >= 0) {
 				if (!memcmp(nesadapter->arp_table[arpindex].mac_addr,
@@ -1381,7 +1384,8 @@ static int nes_addr_resolve_neigh(struct nes_vnic *nesvnic, u32 dst_ip, int arpi
 	}
 
 out:
-	rcu_read_unlock();
+	if (neigh)
+		neigh_release(neigh);
 	ip_rt_put(rt);
 	return rc;
 }
@@ -47,6 +47,7 @@
 #include <linux/in.h>
 
 #include <net/dst.h>
+#include <net/route.h>
 
 MODULE_AUTHOR("Roland Dreier");
 MODULE_DESCRIPTION("IP-over-InfiniBand net driver");
@@ -710,12 +711,22 @@ static int ipoib_start_xmit(struct sk_buff *skb, struct net_device *dev)
 {
 	struct ipoib_dev_priv *priv = netdev_priv(dev);
 	struct ipoib_neigh *neigh;
-	struct neighbour *n = NULL;
+	struct neighbour *n = NULL, *held = NULL;
 	unsigned long flags;
 
 	rcu_read_lock();
 	if (likely(skb_dst(skb))) {
 		n = dst_get_neighbour_noref(skb_dst(skb));
+		if (!n && skb->protocol == htons(ETH_P_IP)) {
+			/* shared route of an on-link nexthop */
+			struct rtable *rt = (struct rtable *) skb_dst(skb);
+			__be32 nexthop = rt_nexthop(rt, ip_hdr(skb)->daddr);
+
+			n = dst_neigh_lookup(skb_dst(skb), &nexthop);
+			if (IS_ERR(n))
+				n = NULL;
+			held = n;
+		}
 		if (!n) {
 			++dev->stats.tx_dropped;
 			dev_kfree_skb_any(skb);
@@ -797,6 +808,8 @@ static int ipoib_start_xmit(struct sk_buff *skb, struct net_device *dev)
 		}
 	}
 unlock:
+	if (held)
+		neigh_release(held);
 	rcu_read_unlock();
 	return NETDEV_TX_OK;
 }
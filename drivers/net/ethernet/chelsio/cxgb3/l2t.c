@@ -299,7 +299,7 @@ static inline void reuse_entry(struct l2t_entry *e, struct neighbour *neigh)
 }
 
 struct l2t_entry *t3_l2t_get(struct t3cdev *cdev, struct dst_entry *dst,
-			     struct net_device *dev)
+			     struct net_device *dev, const void *daddr)
 {
 	struct l2t_entry *e = NULL;
 	struct neighbour *neigh;
@@ -312,8 +312,18 @@ struct l2t_entry *t3_l2t_get(struct t3cdev *cdev, struct dst_entry *dst,
 
 	rcu_read_lock();
 	neigh = dst_get_neighbour_noref(dst);
+	if (neigh)
+		neigh_hold(neigh);
+	rcu_read_unlock();
+
+	/* Shared routes of on-link nexthops carry no neighbour */
+	if (!neigh && daddr) {
+		neigh = dst_neigh_lookup(dst, daddr);
+		if (IS_ERR(neigh))
+			neigh = NULL;
+	}
 	if (!neigh)
-		goto done_rcu;
+		return NULL;
 
 	addr = *(u32 *) neigh->primary_key;
 	ifidx = neigh->dev->ifindex;
@@ -323,6 +333,7 @@ struct l2t_entry *t3_l2t_get(struct t3cdev *cdev, struct dst_entry *dst,
 	p = netdev_priv(dev);
 	smt_idx = p->port_id;
 
+	rcu_read_lock();
 	d = L2DATA(cdev);
 	if (!d)
 		goto done_rcu;
@@ -361,6 +372,7 @@ done_unlock:
 	write_unlock_bh(&d->lock);
 done_rcu:
 	rcu_read_unlock();
+	neigh_release(neigh);
 	return e;
 }
 
@@ -26,6 +26,7 @@
 #include <linux/scatterlist.h>
 #include <linux/if_vlan.h>
 #include <linux/slab.h>
+#include <net/busy_poll.h>
 
 static int napi_weight = 128;
 module_param(napi_weight, int, 0444);
@@ -345,6 +346,8 @@ static void receive_buf(struct net_device *dev, void *buf, unsigned int len)
 		skb_shinfo(skb)->gso_segs = 0;
 	}
 
+	skb_mark_napi_id(skb, &vi->napi);
+
 	netif_receive_skb(skb);
 	return;
 
@@ -512,13 +515,13 @@ static void refill_work(struct work_struct *work)
 		queue_delayed_work(system_nrt_wq, &vi->refill, HZ/2);
 }
 
-static int virtnet_poll(struct napi_struct *napi, int budget)
+/* Called with NAPI_STATE_SCHED held, by NAPI or by busy polling */
+static unsigned int virtnet_receive(struct virtnet_info *vi,
+				    unsigned int budget)
 {
-	struct virtnet_info *vi = container_of(napi, struct virtnet_info, napi);
 	void *buf;
 	unsigned int len, received = 0;
 
-again:
 	while (received < budget &&
 	       (buf = virtqueue_get_buf(vi->rvq, &len)) != NULL) {
 		receive_buf(vi->dev, buf, len);
@@ -531,6 +534,17 @@ again:
 			queue_delayed_work(system_nrt_wq, &vi->refill, 0);
 	}
 
+	return received;
+}
+
+static int virtnet_poll(struct napi_struct *napi, int budget)
+{
+	struct virtnet_info *vi = container_of(napi, struct virtnet_info, napi);
+	unsigned int received = 0;
+
+again:
+	received += virtnet_receive(vi, budget - received);
+
 	/* Out of packets? */
 	if (received < budget) {
 		napi_complete(napi);
@@ -545,6 +559,42 @@ again:
 	return received;
 }
 
+#ifdef CONFIG_NET_RX_BUSY_POLL
+/* must be called with local_bh_disable()d */
+static int virtnet_busy_poll(struct napi_struct *napi)
+{
+	struct virtnet_info *vi = container_of(napi, struct virtnet_info, napi);
+	unsigned int received = 0, budget = 4;
+
+	if (!(vi->status & VIRTIO_NET_S_LINK_UP))
+		return LL_FLUSH_FAILED;
+
+	/* Take the queue from NAPI, as napi_schedule() would.  This fails
+	 * while NAPI is running elsewhere or the device is down.
+	 */
+	if (!napi_schedule_prep(napi))
+		return LL_FLUSH_BUSY;
+
+	virtqueue_disable_cb(vi->rvq);
+
+again:
+	received += virtnet_receive(vi, budget - received);
+
+	smp_mb__before_clear_bit();
+	clear_bit(NAPI_STATE_SCHED, &napi->state);
+	if (unlikely(!virtqueue_enable_cb(vi->rvq)) &&
+	    napi_schedule_prep(napi)) {
+		virtqueue_disable_cb(vi->rvq);
+		if (received < budget)
+			goto again;
+		/* Leave the rest to NAPI */
+		__napi_schedule(napi);
+	}
+
+	return received;
+}
+#endif	/* CONFIG_NET_RX_BUSY_POLL */
+
 static unsigned int free_old_xmit_skbs(struct virtnet_info *vi)
 {
 	struct sk_buff *skb;
@@ -950,6 +1000,9 @@ static const struct net_device_ops virtnet_netdev = {
 #ifdef CONFIG_NET_POLL_CONTROLLER
 	.ndo_poll_controller = virtnet_netpoll,
 #endif
+#ifdef CONFIG_NET_RX_BUSY_POLL
+	.ndo_busy_poll       = virtnet_busy_poll,
+#endif
 };
 
 static void virtnet_update_status(struct virtnet_info *vi)
@@ -1098,6 +1151,8 @@ static int virtnet_probe(struct virtio_device *vdev)
 		goto free_vqs;
 	}
 
+	napi_hash_add(&vi->napi);
+
 	/* Last of all, set up some receive buffers. */
 	try_fill_recv(vi, GFP_KERNEL);
 
@@ -1121,6 +1176,8 @@ static int virtnet_probe(struct virtio_device *vdev)
 	return 0;
 
 unregister:
+	napi_hash_del(&vi->napi);
+	synchronize_rcu_bh();
 	unregister_netdev(dev);
 free_vqs:
 	vdev->config->del_vqs(vdev);
@@ -1170,6 +1227,11 @@ static void __devexit virtnet_remove(struct virtio_device *vdev)
 {
 	struct virtnet_info *vi = vdev->priv;
 
+	/* Busy pollers find the napi under rcu_read_lock_bh(), which
+	 * synchronize_net() in unregister_netdev() does not wait for.
+	 */
+	napi_hash_del(&vi->napi);
+	synchronize_rcu_bh();
 	unregister_netdev(vi->dev);
 
 	remove_vq_common(vi);
@@ -957,6 +957,7 @@ static int init_act_open(struct cxgbi_sock *csk)
 	struct net_device *ndev = cdev->ports[csk->port_id];
 	struct cxgbi_hba *chba = cdev->hbas[csk->port_id];
 	struct sk_buff *skb = NULL;
+	__be32 nexthop;
 
 	log_debug(1 << CXGBI_DBG_TOE | 1 << CXGBI_DBG_SOCK,
 		"csk 0x%p,%u,0x%lx.\n", csk, csk->state, csk->flags);
@@ -966,7 +967,8 @@ static int init_act_open(struct cxgbi_sock *csk)
 		csk->saddr.sin_addr.s_addr = chba->ipv4addr;
 
 	csk->rss_qid = 0;
-	csk->l2t = t3_l2t_get(t3dev, dst, ndev);
+	nexthop = rt_nexthop((struct rtable *)dst, csk->daddr.sin_addr.s_addr);
+	csk->l2t = t3_l2t_get(t3dev, dst, ndev, &nexthop);
 	if (!csk->l2t) {
 		pr_err("NO l2t available.\n");
 		return -EINVAL;
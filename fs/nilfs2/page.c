@@ -337,6 +337,7 @@ repeat:
 			page_cache_release(dpage);
 		} else {
 			struct page *page2;
+			void **slot;
 
 			/* move the page to the destination cache */
 			spin_lock_irq(&smap->tree_lock);
@@ -347,7 +348,22 @@ repeat:
 			spin_unlock_irq(&smap->tree_lock);
 
 			spin_lock_irq(&dmap->tree_lock);
-			err = radix_tree_insert(&dmap->page_tree, offset, page);
+			slot = radix_tree_lookup_slot(&dmap->page_tree, offset);
+			if (slot) {
+				void *p;
+
+				/* take over a shadow entry left by reclaim */
+				p = radix_tree_deref_slot_protected(slot,
+							&dmap->tree_lock);
+				if (radix_tree_exceptional_entry(p)) {
+					radix_tree_replace_slot(slot, page);
+					dmap->nrshadows--;
+					err = 0;
+				} else
+					err = -EEXIST;
+			} else
+				err = radix_tree_insert(&dmap->page_tree,
+							offset, page);
 			if (unlikely(err < 0)) {
 				WARN_ON(err == -EEXIST);
 				page->mapping = NULL;
@@ -21,6 +21,7 @@
 #define AT_VECTOR_SIZE (2*(AT_VECTOR_SIZE_ARCH + AT_VECTOR_SIZE_BASE + 1))
 
 struct address_space;
+struct futex_hash_bucket;
 
 #define USE_SPLIT_PTLOCKS	(NR_CPUS >= CONFIG_SPLIT_PTLOCK_CPUS)
 
@@ -249,6 +250,10 @@ struct vm_area_struct {
 #ifndef CONFIG_MMU
 	struct vm_region *vm_region;	/* NOMMU mapping region */
 #endif
+#ifdef CONFIG_SWAP
+	atomic_long_t swap_readahead_info; /* Last swap fault and its
+					    * readahead window and hits */
+#endif
 #ifdef CONFIG_NUMA
 	struct mempolicy *vm_policy;	/* NUMA policy for the VMA */
 #endif
@@ -385,6 +390,25 @@ struct mm_struct {
 #ifdef CONFIG_TRANSPARENT_HUGEPAGE
 	pgtable_t pmd_huge_pte; /* protected by page_table_lock */
 #endif
+#ifdef CONFIG_NUMA_BALANCING
+	/*
+	 * numa_next_scan is the next time (in jiffies) a thread of this
+	 * mm may start a NUMA hinting scan; numa_scan_offset is where that
+	 * scan resumes, and numa_scan_seq counts completed passes over the
+	 * address space.
+	 */
+	unsigned long numa_next_scan;
+	unsigned long numa_scan_offset;
+	int numa_scan_seq;
+#endif
+#ifdef CONFIG_FUTEX
+	/*
+	 * Optional hash table for the futexes private to this mm, set up
+	 * with prctl(PR_FUTEX_HASH) instead of sharing the global one.
+	 */
+	struct futex_hash_bucket *futex_hash;
+	unsigned long futex_hash_mask;
+#endif
 #ifdef CONFIG_CPUMASK_OFFSTACK
 	struct cpumask cpumask_allocation;
 #endif
@@ -116,6 +116,9 @@ extern int kptr_restrict;
 
 void log_buf_kexec_setup(void);
 void __init setup_log_buf(int early);
+
+struct file_operations;
+extern const struct file_operations kmsg_fops;
 #else
 static inline __printf(1, 0)
 int vprintk(const char *s, va_list args)
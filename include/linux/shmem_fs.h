@@ -31,6 +31,7 @@ struct shmem_sb_info {
 	uid_t uid;		    /* Mount uid for root directory */
 	gid_t gid;		    /* Mount gid for root directory */
 	umode_t mode;		    /* Mount mode for root directory */
+	unsigned char huge;	    /* Whether to try for huge pages */
 	struct mempolicy *mpol;     /* default memory policy for mappings */
 };
 
@@ -54,6 +55,25 @@ extern struct page *shmem_read_mapping_page_gfp(struct address_space *mapping,
 extern void shmem_truncate_range(struct inode *inode, loff_t start, loff_t end);
 extern int shmem_unuse(swp_entry_t entry, struct page *page);
 
+#if defined(CONFIG_SHMEM) && defined(CONFIG_TRANSPARENT_HUGEPAGE)
+struct kobj_attribute;
+extern struct kobj_attribute shmem_enabled_attr;
+extern bool shmem_huge_enabled(struct vm_area_struct *vma);
+extern int shmem_collapse_huge_page(struct vm_area_struct *vma,
+				unsigned long address, unsigned int max_none);
+#else
+static inline bool shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	return false;
+}
+
+static inline int shmem_collapse_huge_page(struct vm_area_struct *vma,
+				unsigned long address, unsigned int max_none)
+{
+	return -EINVAL;
+}
+#endif
+
 static inline struct page *shmem_read_mapping_page(
 				struct address_space *mapping, pgoff_t index)
 {
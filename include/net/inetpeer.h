@@ -12,6 +12,7 @@
 #include <linux/jiffies.h>
 #include <linux/spinlock.h>
 #include <linux/rtnetlink.h>
+#include <linux/tcp.h>
 #include <net/ipv6.h>
 #include <linux/atomic.h>
 
@@ -41,6 +42,12 @@ struct inet_peer {
 	u32			pmtu_orig;
 	u32			pmtu_learned;
 	struct inetpeer_addr_base redirect_learned;
+
+	/* TCP Fast Open client cache, see tcp_fastopen_cache_get() */
+	u16			tcp_fastopen_mss;
+	u16			tcp_fastopen_syn_loss;	/* Recurring SYN losses */
+	unsigned long		tcp_fastopen_last_syn_loss;
+	struct tcp_fastopen_cookie tcp_fastopen_cookie;
 	/*
 	 * Once inet_peer is queued for deletion (refcnt == -1), following fields
 	 * are not available: rid, ip_id_count, tcp_ts, tcp_ts_stamp
@@ -94,6 +101,8 @@ static inline struct inet_peer *inet_getpeer_v6(const struct in6_addr *v6daddr,
 
 /* can be called from BH context or outside */
 extern void inet_putpeer(struct inet_peer *p);
+extern bool inet_xrlim_allow(u32 *rate_tokens, unsigned long *rate_last,
+			     int timeout);
 extern bool inet_peer_xrlim_allow(struct inet_peer *peer, int timeout);
 
 /*
@@ -57,11 +57,11 @@ struct rtable {
 	__be32			rt_dst;	/* Path destination	*/
 	__be32			rt_src;	/* Path source		*/
 	int			rt_route_iif;
-	int			rt_iif;
+	int			rt_iif;	/* 0 in shared input routes */
 	int			rt_oif;
 	__u32			rt_mark;
 
-	/* Info on neighbour */
+	/* Info on neighbour, 0 in shared routes of on-link nexthops */
 	__be32			rt_gateway;
 
 	/* Miscellaneous cached information */
@@ -69,6 +69,7 @@ struct rtable {
 	u32			rt_peer_genid;
 	struct inet_peer	*peer; /* long-living peer info */
 	struct fib_info		*fi; /* for client ref to shared metrics */
+	struct list_head	rt_uncached; /* private routes, see rt_flush_dev() */
 };
 
 static inline bool rt_is_input_route(const struct rtable *rt)
@@ -81,6 +82,14 @@ static inline bool rt_is_output_route(const struct rtable *rt)
 	return rt->rt_route_iif == 0;
 }
 
+/* The address a packet to @daddr routed through @rt is handed to. */
+static inline __be32 rt_nexthop(const struct rtable *rt, __be32 daddr)
+{
+	if (rt->rt_gateway)
+		return rt->rt_gateway;
+	return daddr;
+}
+
 struct ip_rt_acct {
 	__u32 	o_bytes;
 	__u32 	o_packets;
@@ -113,8 +122,9 @@ struct in_device;
 extern int		ip_rt_init(void);
 extern void		ip_rt_redirect(__be32 old_gw, __be32 dst, __be32 new_gw,
 				       __be32 src, struct net_device *dev);
-extern void		rt_cache_flush(struct net *net, int how);
-extern void		rt_cache_flush_batch(struct net *net);
+extern void		rt_cache_flush(struct net *net);
+extern void		rt_flush_nexthop(struct fib_nh *nh);
+extern void		rt_flush_dev(struct net_device *dev);
 extern struct rtable *__ip_route_output_key(struct net *, struct flowi4 *flp);
 extern struct rtable *ip_route_output_flow(struct net *, struct flowi4 *flp,
 					   struct sock *sk);
@@ -190,7 +200,6 @@ extern unsigned		inet_dev_addr_type(struct net *net, const struct net_device *de
 extern void		ip_rt_multicast_event(struct in_device *);
 extern int		ip_rt_ioctl(struct net *, unsigned int cmd, void __user *arg);
 extern void		ip_rt_get_source(u8 *src, struct sk_buff *skb, struct rtable *rt);
-extern int		ip_rt_dump(struct sk_buff *skb,  struct netlink_callback *cb);
 
 struct in_ifaddr;
 extern void fib_add_ifaddr(struct in_ifaddr *);
@@ -307,7 +316,11 @@ static inline struct inet_peer *rt_get_peer(struct rtable *rt, __be32 daddr)
 
 static inline int inet_iif(const struct sk_buff *skb)
 {
-	return skb_rtable(skb)->rt_iif;
+	int iif = skb_rtable(skb)->rt_iif;
+
+	if (iif)
+		return iif;
+	return skb->skb_iif;
 }
 
 extern int sysctl_ip_default_ttl;
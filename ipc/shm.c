@@ -55,6 +55,7 @@ struct shm_file_data {
 
 static const struct file_operations shm_file_operations;
 static const struct vm_operations_struct shm_vm_ops;
+static const struct vm_operations_struct shm_huge_vm_ops;
 
 #define shm_ids(ns)	((ns)->ids[IPC_SHM_IDS])
 
@@ -329,6 +330,17 @@ static int shm_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	return sfd->vm_ops->fault(vma, vmf);
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static int shm_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+			 pmd_t *pmd, unsigned int flags)
+{
+	struct file *file = vma->vm_file;
+	struct shm_file_data *sfd = shm_file_data(file);
+
+	return sfd->vm_ops->pmd_fault(vma, address, pmd, flags);
+}
+#endif
+
 #ifdef CONFIG_NUMA
 static int shm_set_policy(struct vm_area_struct *vma, struct mempolicy *new)
 {
@@ -368,7 +380,11 @@ static int shm_mmap(struct file * file, struct vm_area_struct * vma)
 #ifdef CONFIG_MMU
 	BUG_ON(!sfd->vm_ops->fault);
 #endif
-	vma->vm_ops = &shm_vm_ops;
+	/* Only advertise pmd_fault when the backing shmem provides it */
+	if (sfd->vm_ops->pmd_fault)
+		vma->vm_ops = &shm_huge_vm_ops;
+	else
+		vma->vm_ops = &shm_vm_ops;
 	shm_open(vma);
 
 	return ret;
@@ -435,6 +451,24 @@ static const struct vm_operations_struct shm_vm_ops = {
 #endif
 };
 
+static const struct vm_operations_struct shm_huge_vm_ops = {
+	.open	= shm_open,	/* callback for a new vm-area open */
+	.close	= shm_close,	/* callback for when the vm-area is released */
+	.fault	= shm_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault = shm_pmd_fault,
+#endif
+#if defined(CONFIG_NUMA)
+	.set_policy = shm_set_policy,
+	.get_policy = shm_get_policy,
+#endif
+};
+
+static inline int is_shm_vma(struct vm_area_struct *vma)
+{
+	return vma->vm_ops == &shm_vm_ops || vma->vm_ops == &shm_huge_vm_ops;
+}
+
 /**
  * newseg - Create a new shared memory segment
  * @ns: namespace
@@ -1148,7 +1182,7 @@ SYSCALL_DEFINE1(shmdt, char __user *, shmaddr)
 		 * a fragment created by mprotect() and/or munmap(), or it
 		 * otherwise it starts at this address with no hassles.
 		 */
-		if ((vma->vm_ops == &shm_vm_ops) &&
+		if (is_shm_vma(vma) &&
 			(vma->vm_start - addr)/PAGE_SIZE == vma->vm_pgoff) {
 
 
@@ -1177,7 +1211,7 @@ SYSCALL_DEFINE1(shmdt, char __user *, shmaddr)
 		next = vma->vm_next;
 
 		/* finding a matching vma now does not alter retval */
-		if ((vma->vm_ops == &shm_vm_ops) &&
+		if (is_shm_vma(vma) &&
 			(vma->vm_start - addr)/PAGE_SIZE == vma->vm_pgoff)
 
 			do_munmap(mm, vma->vm_start, vma->vm_end - vma->vm_start);
@@ -1188,7 +1222,7 @@ SYSCALL_DEFINE1(shmdt, char __user *, shmaddr)
 	/* under NOMMU conditions, the exact address to be destroyed must be
 	 * given */
 	retval = -EINVAL;
-	if (vma->vm_start == addr && vma->vm_ops == &shm_vm_ops) {
+	if (vma->vm_start == addr && is_shm_vma(vma)) {
 		do_munmap(mm, vma->vm_start, vma->vm_end - vma->vm_start);
 		retval = 0;
 	}
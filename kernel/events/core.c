@@ -2485,6 +2485,15 @@ void perf_event_task_tick(void)
 	}
 }
 
+/*
+ * Frequency adjustment and multiplexing rotation are driven from the
+ * tick; a full dynticks cpu has to keep it while either is needed.
+ */
+bool perf_event_can_stop_tick(void)
+{
+	return list_empty(&__get_cpu_var(rotation_list));
+}
+
 static int event_enable_on_exec(struct perf_event *event,
 				struct perf_event_context *ctx)
 {
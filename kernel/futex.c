@@ -59,6 +59,10 @@
 #include <linux/magic.h>
 #include <linux/pid.h>
 #include <linux/nsproxy.h>
+#include <linux/bootmem.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/prctl.h>
 
 #include <asm/futex.h>
 
@@ -66,8 +70,6 @@
 
 int __read_mostly futex_cmpxchg_enabled;
 
-#define FUTEX_HASHBITS (CONFIG_BASE_SMALL ? 4 : 8)
-
 /*
  * Futex flags used to encode options to functions and preserve them across
  * restarts.
@@ -145,19 +147,38 @@ static const struct futex_q futex_q_init = {
 struct futex_hash_bucket {
 	spinlock_t lock;
 	struct plist_head chain;
-};
+} ____cacheline_aligned_in_smp;
+
+/*
+ * The global hash table is sized to the machine at boot, so that the
+ * futexes of many threads on many CPUs do not pile up on a few bucket
+ * locks; on NUMA it is spread over the nodes like the other large
+ * system hashes.
+ */
+static struct futex_hash_bucket *futex_queues __read_mostly;
+static unsigned long futex_hashsize __read_mostly;
 
-static struct futex_hash_bucket futex_queues[1<<FUTEX_HASHBITS];
+/* Bounds of a per-process private futex hash, in slots */
+#define FUTEX_PRIVATE_HASH_MIN	16UL
+#define FUTEX_PRIVATE_HASH_MAX	(1UL << 16)
 
 /*
  * We hash on the keys returned from get_futex_key (see below).
+ *
+ * Keys not backed by an inode are only ever used within their mm: those
+ * go to the mm's private hash table, if it has one.
  */
 static struct futex_hash_bucket *hash_futex(union futex_key *key)
 {
 	u32 hash = jhash2((u32*)&key->both.word,
 			  (sizeof(key->both.word)+sizeof(key->both.ptr))/4,
 			  key->both.offset);
-	return &futex_queues[hash & ((1 << FUTEX_HASHBITS)-1)];
+	struct mm_struct *mm = key->private.mm;
+
+	if (!(key->both.offset & FUT_OFF_INODE) && mm->futex_hash)
+		return &mm->futex_hash[hash & mm->futex_hash_mask];
+
+	return &futex_queues[hash & (futex_hashsize - 1)];
 }
 
 /*
@@ -2720,10 +2741,82 @@ SYSCALL_DEFINE6(futex, u32 __user *, uaddr, int, op, u32, val,
 	return do_futex(uaddr, op, val, tp, uaddr2, val2, val3);
 }
 
+static void futex_hash_init(struct futex_hash_bucket *hb, unsigned long size)
+{
+	unsigned long i;
+
+	for (i = 0; i < size; i++) {
+		plist_head_init(&hb[i].chain);
+		spin_lock_init(&hb[i].lock);
+	}
+}
+
+/*
+ * prctl(PR_FUTEX_HASH, PR_FUTEX_HASH_SET_SLOTS, slots) gives the process
+ * a private futex hash table of @slots buckets (rounded up to a power of
+ * two), so that its futexes stop sharing bucket locks with, and being
+ * slowed down by, those of the rest of the system.  As the table cannot
+ * be swapped while futexes are queued, it can only be set up once, while
+ * the process is still single threaded.  It is not inherited on fork.
+ *
+ * PR_FUTEX_HASH_GET_SLOTS returns the size of the table, 0 for none.
+ */
+int futex_hash_prctl(unsigned long op, unsigned long slots)
+{
+	struct mm_struct *mm = current->mm;
+	struct futex_hash_bucket *hb;
+	unsigned long size;
+
+	if (!mm)
+		return -EINVAL;
+
+	switch (op) {
+	case PR_FUTEX_HASH_GET_SLOTS:
+		return mm->futex_hash ? mm->futex_hash_mask + 1 : 0;
+	case PR_FUTEX_HASH_SET_SLOTS:
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	if (!slots || slots > FUTEX_PRIVATE_HASH_MAX)
+		return -EINVAL;
+	slots = roundup_pow_of_two(max(slots, FUTEX_PRIVATE_HASH_MIN));
+
+	/* No other thread can have a futex queued in the global table */
+	if (mm->futex_hash || atomic_read(&mm->mm_users) != 1)
+		return -EBUSY;
+
+	size = slots * sizeof(*hb);
+	if (size <= PAGE_SIZE)
+		hb = kmalloc(size, GFP_KERNEL);
+	else
+		hb = vmalloc(size);
+	if (!hb)
+		return -ENOMEM;
+	futex_hash_init(hb, slots);
+
+	mm->futex_hash_mask = slots - 1;
+	mm->futex_hash = hb;
+	return 0;
+}
+
+void futex_hash_free(struct mm_struct *mm)
+{
+	if (!mm->futex_hash)
+		return;
+
+	if (is_vmalloc_addr(mm->futex_hash))
+		vfree(mm->futex_hash);
+	else
+		kfree(mm->futex_hash);
+	mm->futex_hash = NULL;
+}
+
 static int __init futex_init(void)
 {
+	unsigned int futex_shift;
 	u32 curval;
-	int i;
 
 	/*
 	 * This will fail and we want it. Some arch implementations do
@@ -2738,10 +2831,19 @@ static int __init futex_init(void)
 	if (cmpxchg_futex_value_locked(&curval, NULL, 0, 0) == -EFAULT)
 		futex_cmpxchg_enabled = 1;
 
-	for (i = 0; i < ARRAY_SIZE(futex_queues); i++) {
-		plist_head_init(&futex_queues[i].chain);
-		spin_lock_init(&futex_queues[i].lock);
-	}
+#if CONFIG_BASE_SMALL
+	futex_hashsize = 16;
+#else
+	futex_hashsize = roundup_pow_of_two(256 * num_possible_cpus());
+#endif
+
+	futex_queues = alloc_large_system_hash("futex", sizeof(*futex_queues),
+					       futex_hashsize, 0, 0,
+					       &futex_shift, NULL,
+					       futex_hashsize);
+	futex_hashsize = 1UL << futex_shift;
+
+	futex_hash_init(futex_queues, futex_hashsize);
 
 	return 0;
 }
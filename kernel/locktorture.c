@@ -0,0 +1,430 @@
+/*
+ * Module-based torture test facility for locking
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA 02111-1307, USA.
+ *
+ * A set of writer kthreads hammer on a single lock.  Each acquisition
+ * checks that nobody else holds the lock, and each acquisition that
+ * follows a release on another CPU is counted as a handoff, whose
+ * latency is the time from that release to this acquisition.  Heavily
+ * contended handoff latency is what distinguishes lock implementations
+ * (ticket vs. queued spinlocks, for example) on large machines.
+ *
+ * Based on kernel/rcutorture.c.
+ */
+#include <linux/types.h>
+#include <linux/kernel.h>
+#include <linux/init.h>
+#include <linux/module.h>
+#include <linux/kthread.h>
+#include <linux/err.h>
+#include <linux/spinlock.h>
+#include <linux/sched.h>
+#include <linux/atomic.h>
+#include <linux/moduleparam.h>
+#include <linux/delay.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+#include <linux/ktime.h>
+
+MODULE_LICENSE("GPL");
+
+static int nwriters_stress = -1; /* # writer threads, defaults to 2*ncpus */
+static int stat_interval;	/* Interval between stats, in seconds. */
+				/*  Defaults to "only at end of test". */
+static int hold_us;		/* Time to hold the lock for, in us. */
+static bool verbose;		/* Print more debug info. */
+static char *torture_type = "spin_lock"; /* What lock to torture. */
+
+module_param(nwriters_stress, int, 0444);
+MODULE_PARM_DESC(nwriters_stress, "Number of write-locking stress-test threads");
+module_param(stat_interval, int, 0644);
+MODULE_PARM_DESC(stat_interval, "Number of seconds between stats printk()s");
+module_param(hold_us, int, 0444);
+MODULE_PARM_DESC(hold_us, "Time to hold the lock for (us), 0 for none");
+module_param(verbose, bool, 0444);
+MODULE_PARM_DESC(verbose, "Enable verbose debugging printk()s");
+module_param(torture_type, charp, 0444);
+MODULE_PARM_DESC(torture_type, "Type of lock to torture (spin_lock, spin_lock_irq, lock_busted)");
+
+#define TORTURE_FLAG "-torture:"
+#define VERBOSE_PRINTK_STRING(s) \
+	do { if (verbose) printk(KERN_ALERT "%s" TORTURE_FLAG s "\n", torture_type); } while (0)
+
+static struct task_struct *stats_task;
+static struct task_struct **writer_tasks;
+
+static int nrealwriters_stress;
+static bool lock_is_write_held;
+static atomic_t n_lock_torture_errors;
+
+struct lock_writer_stress_stats {
+	long n_write_lock_fail;
+	long n_write_lock_acquired;
+	long n_handoffs;
+	u64 handoff_ns;
+	u64 handoff_max_ns;
+};
+static struct lock_writer_stress_stats *lwsa;
+
+/*
+ * Written by the lock holder just before it releases the lock, read by
+ * the next holder just after it acquires it.
+ */
+static int last_release_cpu = -1;
+static u64 last_release_ns;
+
+/*
+ * Operations vector for selecting different types of tests.
+ */
+struct lock_torture_ops {
+	void (*init)(void);
+	int (*writelock)(void);
+	void (*write_delay)(void);
+	void (*writeunlock)(void);
+	const char *name;
+};
+
+static struct lock_torture_ops *cur_ops;
+
+/*
+ * Definitions for lock torture testing.
+ */
+
+static int torture_lock_busted_write_lock(void)
+{
+	return 0;  /* BUGGY, do not use in real life!!! */
+}
+
+static void torture_lock_delay(void)
+{
+	if (hold_us)
+		udelay(hold_us);
+}
+
+static void torture_lock_busted_write_unlock(void)
+{
+	  /* BUGGY, do not use in real life!!! */
+}
+
+static struct lock_torture_ops lock_busted_ops = {
+	.writelock	= torture_lock_busted_write_lock,
+	.write_delay	= torture_lock_delay,
+	.writeunlock	= torture_lock_busted_write_unlock,
+	.name		= "lock_busted"
+};
+
+static DEFINE_SPINLOCK(torture_spinlock);
+
+static int torture_spin_lock_write_lock(void) __acquires(torture_spinlock)
+{
+	spin_lock(&torture_spinlock);
+	return 0;
+}
+
+static void torture_spin_lock_write_unlock(void) __releases(torture_spinlock)
+{
+	spin_unlock(&torture_spinlock);
+}
+
+static struct lock_torture_ops spin_lock_ops = {
+	.writelock	= torture_spin_lock_write_lock,
+	.write_delay	= torture_lock_delay,
+	.writeunlock	= torture_spin_lock_write_unlock,
+	.name		= "spin_lock"
+};
+
+/* Only the lock holder looks at this. */
+static unsigned long torture_spinlock_irq_flags;
+
+static int torture_spin_lock_write_lock_irq(void)
+__acquires(torture_spinlock)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&torture_spinlock, flags);
+	torture_spinlock_irq_flags = flags;
+	return 0;
+}
+
+static void torture_lock_spin_write_unlock_irq(void)
+__releases(torture_spinlock)
+{
+	spin_unlock_irqrestore(&torture_spinlock, torture_spinlock_irq_flags);
+}
+
+static struct lock_torture_ops spin_lock_irq_ops = {
+	.writelock	= torture_spin_lock_write_lock_irq,
+	.write_delay	= torture_lock_delay,
+	.writeunlock	= torture_lock_spin_write_unlock_irq,
+	.name		= "spin_lock_irq"
+};
+
+/*
+ * Lock torture writer kthread.  Repeatedly acquires and releases
+ * the lock, checking for duplicate acquisitions and timing handoffs
+ * from other CPUs.
+ */
+static int lock_torture_writer(void *arg)
+{
+	struct lock_writer_stress_stats *lwsp = arg;
+	u64 now, delta;
+	int cpu;
+
+	VERBOSE_PRINTK_STRING("lock_torture_writer task started");
+	set_user_nice(current, 19);
+
+	do {
+		cur_ops->writelock();
+		now = ktime_to_ns(ktime_get());
+		cpu = raw_smp_processor_id();
+
+		if (WARN_ON_ONCE(lock_is_write_held))
+			lwsp->n_write_lock_fail++;
+		lock_is_write_held = 1;
+		lwsp->n_write_lock_acquired++;
+
+		if (last_release_cpu >= 0 && last_release_cpu != cpu) {
+			delta = now - last_release_ns;
+			lwsp->n_handoffs++;
+			lwsp->handoff_ns += delta;
+			if (delta > lwsp->handoff_max_ns)
+				lwsp->handoff_max_ns = delta;
+		}
+
+		cur_ops->write_delay();
+
+		last_release_cpu = cpu;
+		/* ktime_get(), unlike local_clock(), is coherent across
+		 * CPUs, so the acquirer can compare against it.
+		 */
+		last_release_ns = ktime_to_ns(ktime_get());
+		lock_is_write_held = 0;
+		cur_ops->writeunlock();
+
+		cond_resched();
+	} while (!kthread_should_stop());
+
+	VERBOSE_PRINTK_STRING("lock_torture_writer task stopping");
+	return 0;
+}
+
+/*
+ * Create a lock-torture-statistics message in the specified buffer.
+ */
+static void lock_torture_printk(char *page)
+{
+	long max = 0, min = nrealwriters_stress ? lwsa[0].n_write_lock_acquired : 0;
+	long fail = 0, total = 0, handoffs = 0;
+	u64 handoff_ns = 0, handoff_max_ns = 0;
+	int i;
+
+	for (i = 0; i < nrealwriters_stress; i++) {
+		fail += lwsa[i].n_write_lock_fail;
+		total += lwsa[i].n_write_lock_acquired;
+		if (max < lwsa[i].n_write_lock_acquired)
+			max = lwsa[i].n_write_lock_acquired;
+		if (min > lwsa[i].n_write_lock_acquired)
+			min = lwsa[i].n_write_lock_acquired;
+		handoffs += lwsa[i].n_handoffs;
+		handoff_ns += lwsa[i].handoff_ns;
+		if (handoff_max_ns < lwsa[i].handoff_max_ns)
+			handoff_max_ns = lwsa[i].handoff_max_ns;
+	}
+	if (handoffs)
+		do_div(handoff_ns, handoffs);
+
+	page += sprintf(page, "%s%s ", torture_type, TORTURE_FLAG);
+	page += sprintf(page,
+			"Writes:  Total: %ld  Max/Min: %ld/%ld %s  Fail: %ld %s\n",
+			total, max, min, max / 2 > min ? "???" : "",
+			fail, fail ? "!!!" : "");
+	page += sprintf(page, "%s%s ", torture_type, TORTURE_FLAG);
+	sprintf(page, "Handoffs: %ld  Latency avg/max: %llu/%llu ns\n",
+		handoffs, (unsigned long long)handoff_ns,
+		(unsigned long long)handoff_max_ns);
+	if (fail)
+		atomic_inc(&n_lock_torture_errors);
+}
+
+/*
+ * Print torture statistics.  Caller must ensure that there is only one
+ * call to this function at a given time!!!  This is normally accomplished
+ * by relying on the module system to only have one copy of the module
+ * loaded, and then by giving the lock_torture_stats kthread full control
+ * (or the init/cleanup functions when lock_torture_stats thread is not
+ * running).
+ */
+static void lock_torture_stats_print(void)
+{
+	int size = nrealwriters_stress * 200 + 8192;
+	char *buf;
+
+	buf = kmalloc(size, GFP_KERNEL);
+	if (!buf) {
+		printk(KERN_ERR "lock_torture_stats_print: Out of memory, need: %d",
+		       size);
+		return;
+	}
+	lock_torture_printk(buf);
+	printk(KERN_ALERT "%s", buf);
+	kfree(buf);
+}
+
+/*
+ * Periodically prints torture statistics, if periodic statistics printing
+ * was specified via the stat_interval module parameter.
+ */
+static int lock_torture_stats(void *arg)
+{
+	VERBOSE_PRINTK_STRING("lock_torture_stats task started");
+	do {
+		schedule_timeout_interruptible(stat_interval * HZ);
+		lock_torture_stats_print();
+	} while (!kthread_should_stop());
+	VERBOSE_PRINTK_STRING("lock_torture_stats task stopping");
+	return 0;
+}
+
+static inline void
+lock_torture_print_module_parms(struct lock_torture_ops *cur_ops,
+				const char *tag)
+{
+	printk(KERN_ALERT "%s" TORTURE_FLAG
+	       "--- %s: nwriters_stress=%d stat_interval=%d hold_us=%d verbose=%d\n",
+	       torture_type, tag, nrealwriters_stress, stat_interval, hold_us,
+	       verbose);
+}
+
+static void lock_torture_cleanup(void)
+{
+	int i;
+
+	if (writer_tasks) {
+		for (i = 0; i < nrealwriters_stress; i++) {
+			if (writer_tasks[i]) {
+				VERBOSE_PRINTK_STRING("Stopping lock_torture_writer task");
+				kthread_stop(writer_tasks[i]);
+			}
+			writer_tasks[i] = NULL;
+		}
+		kfree(writer_tasks);
+		writer_tasks = NULL;
+	}
+
+	if (stats_task) {
+		VERBOSE_PRINTK_STRING("Stopping lock_torture_stats task");
+		kthread_stop(stats_task);
+	}
+	stats_task = NULL;
+
+	/* Test is done, print the final stats. */
+	if (lwsa)
+		lock_torture_stats_print();
+
+	if (atomic_read(&n_lock_torture_errors))
+		lock_torture_print_module_parms(cur_ops,
+						"End of test: FAILURE");
+	else
+		lock_torture_print_module_parms(cur_ops,
+						"End of test: SUCCESS");
+
+	kfree(lwsa);
+	lwsa = NULL;
+}
+
+static int __init lock_torture_init(void)
+{
+	int i;
+	int firsterr = 0;
+	static struct lock_torture_ops *torture_ops[] = {
+		&lock_busted_ops, &spin_lock_ops, &spin_lock_irq_ops,
+	};
+
+	/* Process args and tell the world that the torturer is on the job. */
+	for (i = 0; i < ARRAY_SIZE(torture_ops); i++) {
+		cur_ops = torture_ops[i];
+		if (strcmp(torture_type, cur_ops->name) == 0)
+			break;
+	}
+	if (i == ARRAY_SIZE(torture_ops)) {
+		printk(KERN_ALERT "lock-torture: invalid torture type: \"%s\"\n",
+		       torture_type);
+		printk(KERN_ALERT "lock-torture types:");
+		for (i = 0; i < ARRAY_SIZE(torture_ops); i++)
+			printk(KERN_ALERT " %s", torture_ops[i]->name);
+		printk(KERN_ALERT "\n");
+		return -EINVAL;
+	}
+	if (cur_ops->init)
+		cur_ops->init(); /* no "goto unwind" prior to this point!!! */
+
+	if (nwriters_stress >= 0)
+		nrealwriters_stress = nwriters_stress;
+	else
+		nrealwriters_stress = 2 * num_online_cpus();
+	lock_torture_print_module_parms(cur_ops, "Start of test");
+
+	/* Initialize the statistics so that each run gets its own numbers. */
+
+	lock_is_write_held = 0;
+	last_release_cpu = -1;
+	lwsa = kcalloc(nrealwriters_stress, sizeof(*lwsa), GFP_KERNEL);
+	if (lwsa == NULL) {
+		VERBOSE_PRINTK_STRING("lwsa: Out of memory");
+		firsterr = -ENOMEM;
+		goto unwind;
+	}
+
+	/* Start up the kthreads. */
+
+	writer_tasks = kcalloc(nrealwriters_stress, sizeof(writer_tasks[0]),
+			       GFP_KERNEL);
+	if (writer_tasks == NULL) {
+		VERBOSE_PRINTK_STRING("writer_tasks: Out of memory");
+		firsterr = -ENOMEM;
+		goto unwind;
+	}
+	for (i = 0; i < nrealwriters_stress; i++) {
+		VERBOSE_PRINTK_STRING("Creating lock_torture_writer task");
+		writer_tasks[i] = kthread_run(lock_torture_writer, &lwsa[i],
+					      "lock_torture_writer");
+		if (IS_ERR(writer_tasks[i])) {
+			firsterr = PTR_ERR(writer_tasks[i]);
+			VERBOSE_PRINTK_STRING("Failed to create writer");
+			writer_tasks[i] = NULL;
+			goto unwind;
+		}
+	}
+	if (stat_interval > 0) {
+		VERBOSE_PRINTK_STRING("Creating lock_torture_stats task");
+		stats_task = kthread_run(lock_torture_stats, NULL,
+					 "lock_torture_stats");
+		if (IS_ERR(stats_task)) {
+			firsterr = PTR_ERR(stats_task);
+			VERBOSE_PRINTK_STRING("Failed to create stats");
+			stats_task = NULL;
+			goto unwind;
+		}
+	}
+	return 0;
+
+unwind:
+	lock_torture_cleanup();
+	return firsterr;
+}
+
+module_init(lock_torture_init);
+module_exit(lock_torture_cleanup);
@@ -8,6 +8,8 @@
 #include <linux/math64.h>
 #include <asm/uaccess.h>
 #include <linux/kernel_stat.h>
+#include <linux/tick.h>
+#include <linux/workqueue.h>
 #include <trace/events/timer.h>
 
 /*
@@ -525,6 +527,27 @@ static inline int expires_gt(cputime_t expires, cputime_t new_exp)
 	return expires == 0 || expires > new_exp;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+static void nohz_kick_work_fn(struct work_struct *work)
+{
+	tick_nohz_full_kick_all();
+}
+
+static DECLARE_WORK(nohz_kick_work, nohz_kick_work_fn);
+
+/*
+ * We need the IPIs to be sent from sane process context.
+ * The posix cpu timers are always set with irqs disabled.
+ */
+static void posix_cpu_timer_kick_nohz(void)
+{
+	if (tick_nohz_full_enabled())
+		schedule_work(&nohz_kick_work);
+}
+#else
+static inline void posix_cpu_timer_kick_nohz(void) { }
+#endif
+
 /*
  * Insert the timer on the appropriate list before any timers that
  * expire later.  This must be called with the tasklist_lock held
@@ -581,6 +604,8 @@ static void arm_timer(struct k_itimer *timer)
 			break;
 		}
 	}
+
+	posix_cpu_timer_kick_nohz();
 }
 
 /*
@@ -1031,6 +1056,23 @@ static inline int task_cputime_zero(const struct task_cputime *cputime)
 	return 0;
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * CPU timers are checked from the tick; a full dynticks cpu cannot stop
+ * it while the running task or its thread group has one armed.
+ */
+bool posix_cpu_timers_can_stop_tick(struct task_struct *tsk)
+{
+	if (!task_cputime_zero(&tsk->cputime_expires))
+		return false;
+
+	if (tsk->signal->cputimer.running)
+		return false;
+
+	return true;
+}
+#endif
+
 /*
  * Check for any per-thread CPU timers that have fired and move them
  * off the tsk->*_timers list onto the firing list.  Per-thread timers
@@ -1389,6 +1431,8 @@ void set_process_cpu_timer(struct task_struct *tsk, unsigned int clock_idx,
 			tsk->signal->cputime_expires.virt_exp = *newval;
 		break;
 	}
+
+	posix_cpu_timer_kick_nohz();
 }
 
 static int do_cpu_nanosleep(const clockid_t which_clock, int flags,
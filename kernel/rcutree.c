@@ -60,7 +60,7 @@
 
 static struct lock_class_key rcu_node_class[NUM_RCU_LVLS];
 
-#define RCU_STATE_INITIALIZER(structname) { \
+#define RCU_STATE_INITIALIZER(structname, sabbr) { \
 	.level = { &structname##_state.node[0] }, \
 	.levelcnt = { \
 		NUM_RCU_LVL_0,  /* root of hierarchy. */ \
@@ -77,12 +77,13 @@ static struct lock_class_key rcu_node_class[NUM_RCU_LVLS];
 	.n_force_qs = 0, \
 	.n_force_qs_ngp = 0, \
 	.name = #structname, \
+	.abbr = sabbr, \
 }
 
-struct rcu_state rcu_sched_state = RCU_STATE_INITIALIZER(rcu_sched);
+struct rcu_state rcu_sched_state = RCU_STATE_INITIALIZER(rcu_sched, 's');
 DEFINE_PER_CPU(struct rcu_data, rcu_sched_data);
 
-struct rcu_state rcu_bh_state = RCU_STATE_INITIALIZER(rcu_bh);
+struct rcu_state rcu_bh_state = RCU_STATE_INITIALIZER(rcu_bh, 'b');
 DEFINE_PER_CPU(struct rcu_data, rcu_bh_data);
 
 static struct rcu_state *rcu_state;
@@ -1700,9 +1701,14 @@ static void invoke_rcu_core(void)
 	raise_softirq(RCU_SOFTIRQ);
 }
 
+/*
+ * Queue a callback for invocation after a grace period.  If @offload
+ * is set and the current CPU is a no-CBs CPU, the callback is handed
+ * to that CPU's rcuo kthread instead of being invoked from RCU_SOFTIRQ.
+ */
 static void
 __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
-	   struct rcu_state *rsp)
+	   struct rcu_state *rsp, bool offload)
 {
 	unsigned long flags;
 	struct rcu_data *rdp;
@@ -1722,6 +1728,12 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
 	local_irq_save(flags);
 	rdp = this_cpu_ptr(rsp->rda);
 
+	/* No-CBs CPUs leave grace-period waiting to their kthread. */
+	if (offload && __call_rcu_nocb(rdp, head)) {
+		local_irq_restore(flags);
+		return;
+	}
+
 	/* Add the callback to our list. */
 	*rdp->nxttail[RCU_NEXT_TAIL] = head;
 	rdp->nxttail[RCU_NEXT_TAIL] = &head->next;
@@ -1778,7 +1790,7 @@ __call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu),
  */
 void call_rcu_sched(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_sched_state);
+	__call_rcu(head, func, &rcu_sched_state, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu_sched);
 
@@ -1787,7 +1799,7 @@ EXPORT_SYMBOL_GPL(call_rcu_sched);
  */
 void call_rcu_bh(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_bh_state);
+	__call_rcu(head, func, &rcu_bh_state, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu_bh);
 
@@ -1935,7 +1947,25 @@ static int rcu_cpu_has_callbacks(int cpu)
 	       rcu_preempt_needs_cpu(cpu);
 }
 
+#ifdef CONFIG_NO_HZ_FULL
+/*
+ * Can a full dynticks CPU stop its tick?  Beyond rcu_pending() and
+ * queued callbacks, a CPU that still owes a quiescent state to the
+ * current grace period must keep taking the tick so that the state
+ * gets noticed and reported.  The force-quiescent-state IPI restarts
+ * the tick on a CPU that stopped it before the grace period began.
+ */
+int rcu_cpu_needs_tick(int cpu)
+{
+	return rcu_pending(cpu) || rcu_cpu_has_callbacks(cpu) ||
+	       per_cpu(rcu_sched_data, cpu).qs_pending ||
+	       per_cpu(rcu_bh_data, cpu).qs_pending ||
+	       rcu_preempt_qs_pending(cpu);
+}
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+
 static DEFINE_PER_CPU(struct rcu_head, rcu_barrier_head) = {NULL};
+static DEFINE_PER_CPU(struct rcu_head, rcu_barrier_list_head) = {NULL};
 static atomic_t rcu_barrier_cpu_count;
 static DEFINE_MUTEX(rcu_barrier_mutex);
 static struct completion rcu_barrier_completion;
@@ -1948,26 +1978,32 @@ static void rcu_barrier_callback(struct rcu_head *notused)
 
 /*
  * Called with preemption disabled, and from cross-cpu IRQ context.
+ * The no-CBs lists are handled separately by rcu_nocb_barrier(), but
+ * a no-CBs CPU may still have callbacks on its normal list: adopted
+ * orphans, and the grace-period waits that rcu_nocb_wait_gp() queues
+ * without offloading.  If so, queue a second barrier callback there.
  */
 static void rcu_barrier_func(void *type)
 {
 	int cpu = smp_processor_id();
+	struct rcu_state *rsp = type;
+	struct rcu_data *rdp = per_cpu_ptr(rsp->rda, cpu);
 	struct rcu_head *head = &per_cpu(rcu_barrier_head, cpu);
-	void (*call_rcu_func)(struct rcu_head *head,
-			      void (*func)(struct rcu_head *head));
 
+	if (is_nocb_cpu(cpu)) {
+		if (!rdp->qlen)
+			return;
+		head = &per_cpu(rcu_barrier_list_head, cpu);
+	}
 	atomic_inc(&rcu_barrier_cpu_count);
-	call_rcu_func = type;
-	call_rcu_func(head, rcu_barrier_callback);
+	__call_rcu(head, rcu_barrier_callback, rsp, false);
 }
 
 /*
  * Orchestrate the specified type of RCU barrier, waiting for all
  * RCU callbacks of the specified type to complete.
  */
-static void _rcu_barrier(struct rcu_state *rsp,
-			 void (*call_rcu_func)(struct rcu_head *head,
-					       void (*func)(struct rcu_head *head)))
+static void _rcu_barrier(struct rcu_state *rsp)
 {
 	BUG_ON(in_interrupt());
 	/* Take mutex to serialize concurrent rcu_barrier() requests. */
@@ -1985,7 +2021,8 @@ static void _rcu_barrier(struct rcu_state *rsp,
 	 * CPU has queued its RCU-barrier callback.
 	 */
 	atomic_set(&rcu_barrier_cpu_count, 1);
-	on_each_cpu(rcu_barrier_func, (void *)call_rcu_func, 1);
+	on_each_cpu(rcu_barrier_func, (void *)rsp, 1);
+	rcu_nocb_barrier(rsp);
 	if (atomic_dec_and_test(&rcu_barrier_cpu_count))
 		complete(&rcu_barrier_completion);
 	wait_for_completion(&rcu_barrier_completion);
@@ -1997,7 +2034,7 @@ static void _rcu_barrier(struct rcu_state *rsp,
  */
 void rcu_barrier_bh(void)
 {
-	_rcu_barrier(&rcu_bh_state, call_rcu_bh);
+	_rcu_barrier(&rcu_bh_state);
 }
 EXPORT_SYMBOL_GPL(rcu_barrier_bh);
 
@@ -2006,7 +2043,7 @@ EXPORT_SYMBOL_GPL(rcu_barrier_bh);
  */
 void rcu_barrier_sched(void)
 {
-	_rcu_barrier(&rcu_sched_state, call_rcu_sched);
+	_rcu_barrier(&rcu_sched_state);
 }
 EXPORT_SYMBOL_GPL(rcu_barrier_sched);
 
@@ -2033,6 +2070,7 @@ rcu_boot_init_percpu_data(int cpu, struct rcu_state *rsp)
 	WARN_ON_ONCE(atomic_read(&rdp->dynticks->dynticks) != 1);
 	rdp->cpu = cpu;
 	rdp->rsp = rsp;
+	rcu_boot_init_nocb_percpu_data(rdp);
 	raw_spin_unlock_irqrestore(&rnp->lock, flags);
 }
 
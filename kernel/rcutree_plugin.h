@@ -26,6 +26,8 @@
 
 #include <linux/delay.h>
 #include <linux/stop_machine.h>
+#include <linux/bootmem.h>
+#include <linux/tick.h>
 
 #define RCU_KTHREAD_PRIO 1
 
@@ -72,7 +74,7 @@ static void __init rcu_bootup_announce_oddness(void)
 
 #ifdef CONFIG_TREE_PREEMPT_RCU
 
-struct rcu_state rcu_preempt_state = RCU_STATE_INITIALIZER(rcu_preempt);
+struct rcu_state rcu_preempt_state = RCU_STATE_INITIALIZER(rcu_preempt, 'p');
 DEFINE_PER_CPU(struct rcu_data, rcu_preempt_data);
 static struct rcu_state *rcu_state = &rcu_preempt_state;
 
@@ -671,7 +673,7 @@ static void rcu_preempt_do_callbacks(void)
  */
 void call_rcu(struct rcu_head *head, void (*func)(struct rcu_head *rcu))
 {
-	__call_rcu(head, func, &rcu_preempt_state);
+	__call_rcu(head, func, &rcu_preempt_state, true);
 }
 EXPORT_SYMBOL_GPL(call_rcu);
 
@@ -876,12 +878,21 @@ static int rcu_preempt_needs_cpu(int cpu)
 	return !!per_cpu(rcu_preempt_data, cpu).nxtlist;
 }
 
+/*
+ * Does the current preemptible-RCU grace period still need a
+ * quiescent state from this CPU?
+ */
+static int __maybe_unused rcu_preempt_qs_pending(int cpu)
+{
+	return per_cpu(rcu_preempt_data, cpu).qs_pending;
+}
+
 /**
  * rcu_barrier - Wait until all in-flight call_rcu() callbacks complete.
  */
 void rcu_barrier(void)
 {
-	_rcu_barrier(&rcu_preempt_state, call_rcu);
+	_rcu_barrier(&rcu_preempt_state);
 }
 EXPORT_SYMBOL_GPL(rcu_barrier);
 
@@ -1100,6 +1111,15 @@ static int rcu_preempt_needs_cpu(int cpu)
 	return 0;
 }
 
+/*
+ * Because preemptible RCU does not exist, it never needs a quiescent
+ * state from any CPU.
+ */
+static int __maybe_unused rcu_preempt_qs_pending(int cpu)
+{
+	return 0;
+}
+
 /*
  * Because preemptible RCU does not exist, rcu_barrier() is just
  * another name for rcu_barrier_sched().
@@ -2197,3 +2217,263 @@ static void rcu_prepare_for_idle(int cpu)
 }
 
 #endif /* #else #if !defined(CONFIG_RCU_FAST_NO_HZ) */
+
+#ifdef CONFIG_RCU_NOCB_CPU
+
+/*
+ * Offload callback processing from the boot-parameter-specified
+ * no-CBs CPUs, plus any full dynticks CPUs.  Callbacks queued on these
+ * CPUs are not invoked from RCU_SOFTIRQ.  Instead, each no-CBs CPU has
+ * one "rcuo" kthread per RCU flavor, which waits for a grace period
+ * and then invokes the callbacks.  These kthreads are not bound to any
+ * CPU, so that they can be affined to housekeeping CPUs.
+ *
+ * A no-CBs CPU still takes part in grace periods: it reports its
+ * quiescent states like any other CPU.  The grace-period wait of each
+ * rcuo kthread is itself a normal callback queued on whatever CPU the
+ * kthread happens to be running on, so that grace periods are still
+ * started even when every CPU is a no-CBs CPU.
+ */
+
+static cpumask_var_t rcu_nocb_mask; /* CPUs to have callbacks offloaded. */
+static bool have_rcu_nocb_mask;	    /* Was rcu_nocb_mask allocated? */
+static bool rcu_nocb_poll;	    /* Offload kthreads are to poll. */
+
+/* Parse the boot-time rcu_nocbs= CPU list from the kernel parameters. */
+static int __init rcu_nocb_setup(char *str)
+{
+	alloc_bootmem_cpumask_var(&rcu_nocb_mask);
+	have_rcu_nocb_mask = true;
+	cpulist_parse(str, rcu_nocb_mask);
+	return 1;
+}
+__setup("rcu_nocbs=", rcu_nocb_setup);
+
+static int __init parse_rcu_nocb_poll(char *arg)
+{
+	rcu_nocb_poll = 1;
+	return 0;
+}
+early_param("rcu_nocb_poll", parse_rcu_nocb_poll);
+
+/* Is the specified CPU a no-CBs CPU? */
+static bool is_nocb_cpu(int cpu)
+{
+	if (have_rcu_nocb_mask && cpumask_test_cpu(cpu, rcu_nocb_mask))
+		return true;
+	return tick_nohz_full_cpu(cpu);
+}
+
+/*
+ * Enqueue the specified string of rcu_head structures onto the
+ * specified CPU's no-CBs lists.  The CPU is specified by rdp, the
+ * head of the string by rhp, and the tail of the string by rhtp.
+ * The caller need not be running on the specified CPU: enqueueing
+ * is lock-free and safe against concurrent enqueuers.
+ */
+static void __call_rcu_nocb_enqueue(struct rcu_data *rdp,
+				    struct rcu_head *rhp,
+				    struct rcu_head **rhtp,
+				    long rhcount)
+{
+	struct rcu_head **old_rhpp;
+	struct task_struct *t;
+
+	/* Enqueue the callback on the nocb list and update counts. */
+	old_rhpp = xchg(&rdp->nocb_tail, rhtp);
+	ACCESS_ONCE(*old_rhpp) = rhp;
+	atomic_long_add(rhcount, &rdp->nocb_q_count);
+
+	/* If we are not being polled and there is a kthread, awaken it. */
+	t = ACCESS_ONCE(rdp->nocb_kthread);
+	if (rcu_nocb_poll || !t)
+		return;
+	if (old_rhpp == &rdp->nocb_head)
+		wake_up(&rdp->nocb_wq); /* ... only if queue was empty. */
+}
+
+/*
+ * This is a helper for __call_rcu().  If this is not a no-CBs CPU,
+ * this function returns failure back to __call_rcu(), which then
+ * queues the callback on the normal per-CPU list.  Otherwise, this
+ * function queues the callback where the corresponding "rcuo" kthread
+ * can find it.
+ */
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp)
+{
+	if (!is_nocb_cpu(rdp->cpu))
+		return false;
+	__call_rcu_nocb_enqueue(rdp, rhp, &rhp->next, 1);
+	return true;
+}
+
+/*
+ * Queue the rcu_barrier() callback on every no-CBs CPU, online or not:
+ * a no-CBs CPU's kthread keeps invoking its callbacks after the CPU
+ * goes offline.  Because the no-CBs lists are FIFO and each kthread
+ * invokes its batches in order, the barrier callback runs only after
+ * all callbacks that were queued before it.
+ */
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+	int cpu;
+	struct rcu_head *head;
+
+	for_each_possible_cpu(cpu) {
+		if (!is_nocb_cpu(cpu))
+			continue;
+		head = &per_cpu(rcu_barrier_head, cpu);
+		debug_rcu_head_queue(head);
+		head->func = rcu_barrier_callback;
+		head->next = NULL;
+		atomic_inc(&rcu_barrier_cpu_count);
+		__call_rcu_nocb_enqueue(per_cpu_ptr(rsp->rda, cpu),
+					head, &head->next, 1);
+	}
+}
+
+/*
+ * Wait for a grace period of the kthread's flavor to elapse.  The
+ * callback is queued without offloading, as otherwise two rcuo
+ * kthreads could end up waiting on each other.
+ */
+static void rcu_nocb_wait_gp(struct rcu_data *rdp)
+{
+	struct rcu_synchronize rcu;
+
+	init_rcu_head_on_stack(&rcu.head);
+	init_completion(&rcu.completion);
+	__call_rcu(&rcu.head, wakeme_after_rcu, rdp->rsp, false);
+	wait_for_completion(&rcu.completion);
+	destroy_rcu_head_on_stack(&rcu.head);
+}
+
+/*
+ * Per-rcu_data kthread, but only for no-CBs CPUs.  Each kthread invokes
+ * callbacks queued by the corresponding no-CBs CPU.
+ */
+static int rcu_nocb_kthread(void *arg)
+{
+	long c;
+	struct rcu_head *list;
+	struct rcu_head *next;
+	struct rcu_head **tail;
+	struct rcu_data *rdp = arg;
+
+	/* Each pass through this loop invokes one batch of callbacks */
+	for (;;) {
+		/* If not polling, wait for next batch of callbacks. */
+		if (!rcu_nocb_poll)
+			wait_event_interruptible(rdp->nocb_wq,
+						 ACCESS_ONCE(rdp->nocb_head));
+		list = ACCESS_ONCE(rdp->nocb_head);
+		if (!list) {
+			schedule_timeout_interruptible(1);
+			continue;
+		}
+
+		/*
+		 * Extract queued callbacks, update counts, and wait
+		 * for a grace period to elapse.
+		 */
+		ACCESS_ONCE(rdp->nocb_head) = NULL;
+		tail = xchg(&rdp->nocb_tail, &rdp->nocb_head);
+		c = atomic_long_xchg(&rdp->nocb_q_count, 0);
+		rcu_nocb_wait_gp(rdp);
+
+		/* Each pass through the following loop invokes a callback. */
+		trace_rcu_batch_start(rdp->rsp->name, c, -1);
+		c = 0;
+		while (list) {
+			next = list->next;
+			/* Wait for enqueuing to complete, if needed. */
+			while (next == NULL && &list->next != tail) {
+				schedule_timeout_interruptible(1);
+				next = list->next;
+			}
+			debug_rcu_head_unqueue(list);
+			local_bh_disable();
+			__rcu_reclaim(rdp->rsp->name, list);
+			local_bh_enable();
+			c++;
+			list = next;
+			cond_resched();
+		}
+		trace_rcu_batch_end(rdp->rsp->name, c, !!list, 0, 0, 1);
+	}
+	return 0;
+}
+
+/* Initialize per-rcu_data variables for no-CBs CPUs. */
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+	rdp->nocb_tail = &rdp->nocb_head;
+	init_waitqueue_head(&rdp->nocb_wq);
+}
+
+/* Create a kthread for each RCU flavor for each no-CBs CPU. */
+static void __init rcu_spawn_nocb_kthreads(struct rcu_state *rsp)
+{
+	int cpu;
+	struct rcu_data *rdp;
+	struct task_struct *t;
+
+	for_each_possible_cpu(cpu) {
+		if (!is_nocb_cpu(cpu))
+			continue;
+		rdp = per_cpu_ptr(rsp->rda, cpu);
+		t = kthread_run(rcu_nocb_kthread, rdp,
+				"rcuo%c/%d", rsp->abbr, cpu);
+		BUG_ON(IS_ERR(t));
+		ACCESS_ONCE(rdp->nocb_kthread) = t;
+	}
+}
+
+static int __init rcu_spawn_all_nocb_kthreads(void)
+{
+	static char nocb_buf[NR_CPUS * 5] __initdata;
+	cpumask_var_t cm;
+
+	if (!zalloc_cpumask_var(&cm, GFP_KERNEL))
+		return -ENOMEM;
+	if (have_rcu_nocb_mask)
+		cpumask_copy(cm, rcu_nocb_mask);
+#ifdef CONFIG_NO_HZ_FULL
+	if (tick_nohz_full_running)
+		cpumask_or(cm, cm, tick_nohz_full_mask);
+#endif /* #ifdef CONFIG_NO_HZ_FULL */
+	if (!cpumask_empty(cm)) {
+		cpulist_scnprintf(nocb_buf, sizeof(nocb_buf), cm);
+		printk(KERN_INFO "RCU: Offloading callbacks from CPUs: %s%s\n",
+		       nocb_buf, rcu_nocb_poll ? " (polling)" : "");
+		rcu_spawn_nocb_kthreads(&rcu_sched_state);
+		rcu_spawn_nocb_kthreads(&rcu_bh_state);
+		if (rcu_state != &rcu_sched_state)
+			rcu_spawn_nocb_kthreads(rcu_state);
+	}
+	free_cpumask_var(cm);
+	return 0;
+}
+early_initcall(rcu_spawn_all_nocb_kthreads);
+
+#else /* #ifdef CONFIG_RCU_NOCB_CPU */
+
+static bool is_nocb_cpu(int cpu)
+{
+	return false;
+}
+
+static bool __call_rcu_nocb(struct rcu_data *rdp, struct rcu_head *rhp)
+{
+	return false;
+}
+
+static void rcu_nocb_barrier(struct rcu_state *rsp)
+{
+}
+
+static void __init rcu_boot_init_nocb_percpu_data(struct rcu_data *rdp)
+{
+}
+
+#endif /* #else #ifdef CONFIG_RCU_NOCB_CPU */
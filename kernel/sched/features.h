@@ -68,3 +68,26 @@ SCHED_FEAT(TTWU_QUEUE, true)
 
 SCHED_FEAT(FORCE_SD_OVERLAP, false)
 SCHED_FEAT(RT_RUNTIME_SHARE, true)
+
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Sample the address space of tasks with NUMA hinting faults and migrate
+ * misplaced pages, see task_tick_numa().
+ */
+SCHED_FEAT(NUMA, true)
+
+/*
+ * NUMA_FAVOUR_HIGHER will favor moving tasks towards nodes where a
+ * higher number of hinting faults are recorded during load balancing.
+ */
+SCHED_FEAT(NUMA_FAVOUR_HIGHER, true)
+
+/*
+ * NUMA_RESIST_LOWER will resist moving tasks towards nodes where a
+ * lower number of hinting faults have been recorded. As this may
+ * return idle CPUs unused, it is off by default.
+ */
+SCHED_FEAT(NUMA_RESIST_LOWER, false)
+#else
+SCHED_FEAT(NUMA, false)
+#endif
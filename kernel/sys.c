@@ -40,6 +40,7 @@
 #include <linux/syscore_ops.h>
 #include <linux/version.h>
 #include <linux/ctype.h>
+#include <linux/futex.h>
 
 #include <linux/compat.h>
 #include <linux/syscalls.h>
@@ -1962,6 +1963,11 @@ SYSCALL_DEFINE5(prctl, int, option, unsigned long, arg2, unsigned long, arg3,
 		case PR_SET_MM:
 			error = prctl_set_mm(arg2, arg3, arg4, arg5);
 			break;
+		case PR_FUTEX_HASH:
+			if (arg4 || arg5)
+				return -EINVAL;
+			error = futex_hash_prctl(arg2, arg3);
+			break;
 		default:
 			error = -EINVAL;
 			break;
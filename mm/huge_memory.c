@@ -17,6 +17,8 @@
 #include <linux/khugepaged.h>
 #include <linux/freezer.h>
 #include <linux/mman.h>
+#include <linux/pagemap.h>
+#include <linux/shmem_fs.h>
 #include <asm/tlb.h>
 #include <asm/pgalloc.h>
 #include "internal.h"
@@ -317,6 +319,9 @@ static struct attribute *hugepage_attr[] = {
 	&defrag_attr.attr,
 #ifdef CONFIG_DEBUG_VM
 	&debug_cow_attr.attr,
+#endif
+#ifdef CONFIG_SHMEM
+	&shmem_enabled_attr.attr,
 #endif
 	NULL,
 };
@@ -748,6 +753,50 @@ out:
 	return handle_pte_fault(mm, vma, address, pte, pmd, flags);
 }
 
+/*
+ * Map the HPAGE_PMD_NR naturally aligned file pages starting at @page,
+ * locked by the caller, with a huge pmd.  Unlike an anonymous hugepage
+ * they are not a compound page: each of them is referenced and rmapped
+ * on its own like a pte mapped page, so the pmd can later be split
+ * into ptes or zapped without touching the pages themselves.
+ */
+int do_huge_pmd_file_page(struct mm_struct *mm, struct vm_area_struct *vma,
+			  unsigned long address, pmd_t *pmd,
+			  struct page *page, unsigned int flags)
+{
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	pgtable_t pgtable;
+	pmd_t entry;
+	int i;
+
+	VM_BUG_ON(page_to_pfn(page) & (HPAGE_PMD_NR - 1));
+	pgtable = pte_alloc_one(mm, haddr);
+	if (unlikely(!pgtable))
+		return VM_FAULT_OOM;
+
+	spin_lock(&mm->page_table_lock);
+	if (unlikely(!pmd_none(*pmd))) {
+		spin_unlock(&mm->page_table_lock);
+		pte_free(mm, pgtable);
+		return 0;
+	}
+	entry = mk_pmd(page, vma->vm_page_prot);
+	entry = pmd_mkhuge(pmd_mkyoung(entry));
+	if (flags & FAULT_FLAG_WRITE)
+		entry = pmd_mkdirty(entry);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		get_page(page + i);
+		page_add_file_rmap(page + i);
+	}
+	set_pmd_at(mm, haddr, pmd, entry);
+	prepare_pmd_huge_pte(pgtable, mm);
+	add_mm_counter(mm, MM_FILEPAGES, HPAGE_PMD_NR);
+	mm->nr_ptes++;
+	spin_unlock(&mm->page_table_lock);
+
+	return 0;
+}
+
 int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		  pmd_t *dst_pmd, pmd_t *src_pmd, unsigned long addr,
 		  struct vm_area_struct *vma)
@@ -781,6 +830,12 @@ int copy_huge_pmd(struct mm_struct *dst_mm, struct mm_struct *src_mm,
 		goto out;
 	}
 	src_page = pmd_page(pmd);
+	if (!PageAnon(src_page)) {
+		/* shared file pages are faulted in again by the child */
+		pte_free(dst_mm, pgtable);
+		ret = 0;
+		goto out_unlock;
+	}
 	VM_BUG_ON(!PageHead(src_page));
 	get_page(src_page);
 	page_dup_rmap(src_page);
@@ -1003,6 +1058,18 @@ struct page *follow_trans_huge_pmd(struct mm_struct *mm,
 		goto out;
 
 	page = pmd_page(*pmd);
+	if (!PageAnon(page)) {
+		/* see do_huge_pmd_file_page() */
+		page += (addr & ~HPAGE_PMD_MASK) >> PAGE_SHIFT;
+		if (flags & FOLL_TOUCH) {
+			if ((flags & FOLL_WRITE) && !PageDirty(page))
+				set_page_dirty(page);
+			mark_page_accessed(page);
+		}
+		if (flags & FOLL_GET)
+			get_page(page);
+		goto out;
+	}
 	VM_BUG_ON(!PageHead(page));
 	if (flags & FOLL_TOUCH) {
 		pmd_t _pmd;
@@ -1026,6 +1093,37 @@ out:
 	return page;
 }
 
+/* called with the page_table_lock held, returns with it released */
+static void zap_huge_file_pmd(struct mmu_gather *tlb,
+			      struct vm_area_struct *vma,
+			      pmd_t *pmd, unsigned long addr)
+{
+	struct mm_struct *mm = tlb->mm;
+	struct page *page;
+	pgtable_t pgtable;
+	pmd_t orig_pmd;
+	int i;
+
+	pgtable = get_pmd_huge_pte(mm);
+	page = pmd_page(*pmd);
+	orig_pmd = pmdp_get_and_clear(mm, addr, pmd);
+	tlb_remove_pmd_tlb_entry(tlb, pmd, addr);
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (pmd_dirty(orig_pmd))
+			set_page_dirty(page + i);
+		if (pmd_young(orig_pmd) &&
+		    likely(!VM_SequentialReadHint(vma)))
+			mark_page_accessed(page + i);
+		page_remove_rmap(page + i);
+	}
+	add_mm_counter(mm, MM_FILEPAGES, -HPAGE_PMD_NR);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+	for (i = 0; i < HPAGE_PMD_NR; i++)
+		tlb_remove_page(tlb, page + i);
+	pte_free(mm, pgtable);
+}
+
 int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 		 pmd_t *pmd, unsigned long addr)
 {
@@ -1037,6 +1135,9 @@ int zap_huge_pmd(struct mmu_gather *tlb, struct vm_area_struct *vma,
 			spin_unlock(&tlb->mm->page_table_lock);
 			wait_split_huge_page(vma->anon_vma,
 					     pmd);
+		} else if (!PageAnon(pmd_page(*pmd))) {
+			zap_huge_file_pmd(tlb, vma, pmd, addr);
+			ret = 1;
 		} else {
 			struct page *page;
 			pgtable_t pgtable;
@@ -1094,6 +1195,7 @@ int move_huge_pmd(struct vm_area_struct *vma, struct vm_area_struct *new_vma,
 	pmd_t pmd;
 
 	struct mm_struct *mm = vma->vm_mm;
+	struct address_space *mapping = NULL;
 
 	if ((old_addr & ~HPAGE_PMD_MASK) ||
 	    (new_addr & ~HPAGE_PMD_MASK) ||
@@ -1110,6 +1212,11 @@ int move_huge_pmd(struct vm_area_struct *vma, struct vm_area_struct *new_vma,
 		goto out;
 	}
 
+	/* keep file rmap walks off the pmd while it moves, as move_ptes() */
+	if (vma->vm_file) {
+		mapping = vma->vm_file->f_mapping;
+		mutex_lock(&mapping->i_mmap_mutex);
+	}
 	spin_lock(&mm->page_table_lock);
 	if (likely(pmd_trans_huge(*old_pmd))) {
 		if (pmd_trans_splitting(*old_pmd)) {
@@ -1126,6 +1233,8 @@ int move_huge_pmd(struct vm_area_struct *vma, struct vm_area_struct *new_vma,
 	} else {
 		spin_unlock(&mm->page_table_lock);
 	}
+	if (mapping)
+		mutex_unlock(&mapping->i_mmap_mutex);
 out:
 	return ret;
 }
@@ -1200,6 +1309,36 @@ out:
 	return ret;
 }
 
+/*
+ * Return the huge pmd mapping @page, one of the pages mapped by
+ * do_huge_pmd_file_page(), at @address in @mm.  Called with the
+ * page_table_lock held.
+ */
+pmd_t *page_check_address_file_pmd(struct page *page,
+				   struct mm_struct *mm,
+				   unsigned long address)
+{
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return NULL;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return NULL;
+
+	pmd = pmd_offset(pud, address);
+	if (!pmd_trans_huge(*pmd))
+		return NULL;
+	if (pmd_page(*pmd) +
+	    ((address & ~HPAGE_PMD_MASK) >> PAGE_SHIFT) != page)
+		return NULL;
+	return pmd;
+}
+
 static int __split_huge_page_splitting(struct page *page,
 				       struct vm_area_struct *vma,
 				       unsigned long address)
@@ -1492,15 +1631,28 @@ out:
 #define VM_NO_THP (VM_SPECIAL|VM_INSERTPAGE|VM_MIXEDMAP|VM_SAO| \
 		   VM_HUGETLB|VM_SHARED|VM_MAYSHARE)
 
+/*
+ * Shared shmem mappings can be mapped with huge pmds too, see
+ * shmem_pmd_fault(), but no other VM_NO_THP mapping can.
+ */
+static unsigned long vma_no_thp_flags(struct vm_area_struct *vma)
+{
+	if (vma->vm_ops && vma->vm_ops->pmd_fault)
+		return VM_NO_THP & ~(VM_SHARED | VM_MAYSHARE);
+	return VM_NO_THP;
+}
+
 int hugepage_madvise(struct vm_area_struct *vma,
 		     unsigned long *vm_flags, int advice)
 {
+	unsigned long no_thp = vma_no_thp_flags(vma);
+
 	switch (advice) {
 	case MADV_HUGEPAGE:
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & (VM_HUGEPAGE | VM_NO_THP))
+		if (*vm_flags & (VM_HUGEPAGE | no_thp))
 			return -EINVAL;
 		*vm_flags &= ~VM_NOHUGEPAGE;
 		*vm_flags |= VM_HUGEPAGE;
@@ -1516,7 +1668,7 @@ int hugepage_madvise(struct vm_area_struct *vma,
 		/*
 		 * Be somewhat over-protective like KSM for now!
 		 */
-		if (*vm_flags & (VM_NOHUGEPAGE | VM_NO_THP))
+		if (*vm_flags & (VM_NOHUGEPAGE | no_thp))
 			return -EINVAL;
 		*vm_flags &= ~VM_HUGEPAGE;
 		*vm_flags |= VM_NOHUGEPAGE;
@@ -1644,15 +1796,19 @@ int __khugepaged_enter(struct mm_struct *mm)
 int khugepaged_enter_vma_merge(struct vm_area_struct *vma)
 {
 	unsigned long hstart, hend;
+	if (vma->vm_ops) {
+		/* of the file mappings khugepaged only works on shmem */
+		if (vma->vm_ops->pmd_fault && shmem_huge_enabled(vma) &&
+		    !test_bit(MMF_VM_HUGEPAGE, &vma->vm_mm->flags))
+			return __khugepaged_enter(vma->vm_mm);
+		return 0;
+	}
 	if (!vma->anon_vma)
 		/*
 		 * Not yet faulted in so we will register later in the
 		 * page fault if needed.
 		 */
 		return 0;
-	if (vma->vm_ops)
-		/* khugepaged not yet working on file or special mappings */
-		return 0;
 	/*
 	 * If is_pfn_mapping() is true is_learn_pfn_mapping() must be
 	 * true too, verify it here.
@@ -2079,6 +2235,89 @@ out:
 	return ret;
 }
 
+/*
+ * Have shmem gather the pages behind a pte mapped range into a team
+ * that can be mapped by a huge pmd, then free the page table so the
+ * next fault maps the team with do_huge_pmd_file_page().  Returns 1
+ * if the mmap_sem was released.
+ */
+static int khugepaged_scan_file(struct mm_struct *mm,
+				struct vm_area_struct *vma,
+				unsigned long address)
+{
+	struct address_space *mapping = vma->vm_file->f_mapping;
+	pgoff_t index = linear_page_index(vma, address);
+	pgd_t *pgd;
+	pud_t *pud;
+	pmd_t *pmd, _pmd;
+
+	VM_BUG_ON(address & ~HPAGE_PMD_MASK);
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		return 0;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		return 0;
+
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		return 0;
+
+	if (shmem_collapse_huge_page(vma, address, khugepaged_max_ptes_none))
+		return 0;
+
+	up_read(&mm->mmap_sem);
+	/*
+	 * The page table can only be freed with the mmap_sem held for
+	 * writing, so that no page fault is walking it.
+	 */
+	down_write(&mm->mmap_sem);
+	if (unlikely(khugepaged_test_exit(mm)))
+		goto out;
+
+	vma = find_vma(mm, address);
+	if (!vma || vma->vm_start > address ||
+	    vma->vm_end < address + HPAGE_PMD_SIZE ||
+	    !vma->vm_ops || !vma->vm_ops->pmd_fault ||
+	    vma->vm_file->f_mapping != mapping ||
+	    linear_page_index(vma, address) != index)
+		goto out;
+
+	pgd = pgd_offset(mm, address);
+	if (!pgd_present(*pgd))
+		goto out;
+
+	pud = pud_offset(pgd, address);
+	if (!pud_present(*pud))
+		goto out;
+
+	pmd = pmd_offset(pud, address);
+	if (!pmd_present(*pmd) || pmd_trans_huge(*pmd))
+		goto out;
+
+	zap_page_range(vma, address, HPAGE_PMD_SIZE, NULL);
+
+	/* stop the rmap walks from looking at the page table */
+	mutex_lock(&mapping->i_mmap_mutex);
+	if (vma->anon_vma)
+		anon_vma_lock(vma->anon_vma);
+	spin_lock(&mm->page_table_lock);
+	_pmd = pmdp_clear_flush_notify(vma, address, pmd);
+	mm->nr_ptes--;
+	spin_unlock(&mm->page_table_lock);
+	if (vma->anon_vma)
+		anon_vma_unlock(vma->anon_vma);
+	mutex_unlock(&mapping->i_mmap_mutex);
+
+	pte_free(mm, pmd_pgtable(_pmd));
+	khugepaged_pages_collapsed++;
+out:
+	up_write(&mm->mmap_sem);
+	return 1;
+}
+
 static void collect_mm_slot(struct mm_slot *mm_slot)
 {
 	struct mm_struct *mm = mm_slot->mm;
@@ -2102,6 +2341,29 @@ static void collect_mm_slot(struct mm_slot *mm_slot)
 	}
 }
 
+static int khugepaged_scan_vma(struct vm_area_struct *vma)
+{
+	/* shmem mappings follow the huge= policy of their mount */
+	if (vma->vm_ops && vma->vm_ops->pmd_fault)
+		return shmem_huge_enabled(vma);
+
+	if ((!(vma->vm_flags & VM_HUGEPAGE) &&
+	     !khugepaged_always()) ||
+	    (vma->vm_flags & VM_NOHUGEPAGE))
+		return 0;
+	if (!vma->anon_vma || vma->vm_ops)
+		return 0;
+	if (is_vma_temporary_stack(vma))
+		return 0;
+	/*
+	 * If is_pfn_mapping() is true is_learn_pfn_mapping()
+	 * must be true too, verify it here.
+	 */
+	VM_BUG_ON(is_linear_pfn_mapping(vma) ||
+		  vma->vm_flags & VM_NO_THP);
+	return 1;
+}
+
 static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 					    struct page **hpage)
 	__releases(&khugepaged_mm_lock)
@@ -2142,23 +2404,11 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			break;
 		}
 
-		if ((!(vma->vm_flags & VM_HUGEPAGE) &&
-		     !khugepaged_always()) ||
-		    (vma->vm_flags & VM_NOHUGEPAGE)) {
+		if (!khugepaged_scan_vma(vma)) {
 		skip:
 			progress++;
 			continue;
 		}
-		if (!vma->anon_vma || vma->vm_ops)
-			goto skip;
-		if (is_vma_temporary_stack(vma))
-			goto skip;
-		/*
-		 * If is_pfn_mapping() is true is_learn_pfn_mapping()
-		 * must be true too, verify it here.
-		 */
-		VM_BUG_ON(is_linear_pfn_mapping(vma) ||
-			  vma->vm_flags & VM_NO_THP);
 
 		hstart = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
 		hend = vma->vm_end & HPAGE_PMD_MASK;
@@ -2179,9 +2429,13 @@ static unsigned int khugepaged_scan_mm_slot(unsigned int pages,
 			VM_BUG_ON(khugepaged_scan.address < hstart ||
 				  khugepaged_scan.address + HPAGE_PMD_SIZE >
 				  hend);
-			ret = khugepaged_scan_pmd(mm, vma,
-						  khugepaged_scan.address,
-						  hpage);
+			if (vma->vm_ops)
+				ret = khugepaged_scan_file(mm, vma,
+						khugepaged_scan.address);
+			else
+				ret = khugepaged_scan_pmd(mm, vma,
+						khugepaged_scan.address,
+						hpage);
 			/* move to next address */
 			khugepaged_scan.address += HPAGE_PMD_SIZE;
 			progress += HPAGE_PMD_NR;
@@ -2374,8 +2628,54 @@ static int khugepaged(void *none)
 	return 0;
 }
 
-void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
+/*
+ * The pages behind a huge pmd set up by do_huge_pmd_file_page() are
+ * already referenced and rmapped one by one, so the pmd is split in
+ * place by filling in the page table deposited at fault time.  Called
+ * with the page_table_lock held.
+ */
+static void __split_huge_file_pmd(struct vm_area_struct *vma,
+				  unsigned long haddr, pmd_t *pmd)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	struct page *page = pmd_page(*pmd);
+	pgtable_t pgtable;
+	pmd_t orig_pmd, _pmd;
+	int i;
+
+	/*
+	 * Clear and flush the huge pmd before the ptes are set up, so
+	 * that the huge and small TLB entries are never loaded together
+	 * (see __split_huge_page_map()) and no dirty bit set by the CPU
+	 * meanwhile gets lost.
+	 */
+	orig_pmd = pmdp_clear_flush_notify(vma, haddr, pmd);
+	pgtable = get_pmd_huge_pte(mm);
+	pmd_populate(mm, &_pmd, pgtable);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++, haddr += PAGE_SIZE) {
+		pte_t *pte, entry;
+		entry = mk_pte(page + i, vma->vm_page_prot);
+		if (!pmd_write(orig_pmd))
+			entry = pte_wrprotect(entry);
+		if (pmd_dirty(orig_pmd))
+			entry = pte_mkdirty(entry);
+		if (!pmd_young(orig_pmd))
+			entry = pte_mkold(entry);
+		pte = pte_offset_map(&_pmd, haddr);
+		BUG_ON(!pte_none(*pte));
+		set_pte_at(mm, haddr, pte, entry);
+		pte_unmap(pte);
+	}
+
+	smp_wmb(); /* make pte visible before pmd */
+	pmd_populate(mm, pmd, pgtable);
+}
+
+void __split_huge_page_pmd(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd)
 {
+	struct mm_struct *mm = vma->vm_mm;
 	struct page *page;
 
 	spin_lock(&mm->page_table_lock);
@@ -2384,6 +2684,11 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 		return;
 	}
 	page = pmd_page(*pmd);
+	if (!PageAnon(page)) {
+		__split_huge_file_pmd(vma, address & HPAGE_PMD_MASK, pmd);
+		spin_unlock(&mm->page_table_lock);
+		return;
+	}
 	VM_BUG_ON(!page_count(page));
 	get_page(page);
 	spin_unlock(&mm->page_table_lock);
@@ -2394,15 +2699,24 @@ void __split_huge_page_pmd(struct mm_struct *mm, pmd_t *pmd)
 	BUG_ON(pmd_trans_huge(*pmd));
 }
 
-static void split_huge_page_address(struct mm_struct *mm,
-				    unsigned long address)
+void split_huge_page_pmd_mm(struct mm_struct *mm, unsigned long address,
+			    pmd_t *pmd)
+{
+	struct vm_area_struct *vma;
+
+	vma = find_vma(mm, address);
+	BUG_ON(vma == NULL);
+	split_huge_page_pmd(vma, address, pmd);
+}
+
+void split_huge_page_address(struct vm_area_struct *vma,
+			     unsigned long address)
 {
+	struct mm_struct *mm = vma->vm_mm;
 	pgd_t *pgd;
 	pud_t *pud;
 	pmd_t *pmd;
 
-	VM_BUG_ON(!(address & ~HPAGE_PMD_MASK));
-
 	pgd = pgd_offset(mm, address);
 	if (!pgd_present(*pgd))
 		return;
@@ -2415,10 +2729,28 @@ static void split_huge_page_address(struct mm_struct *mm,
 	if (!pmd_present(*pmd))
 		return;
 	/*
-	 * Caller holds the mmap_sem write mode, so a huge pmd cannot
-	 * materialize from under us.
+	 * Caller holds the mmap_sem write mode, or the lock of a page
+	 * that a file huge pmd would map (do_huge_pmd_file_page() needs
+	 * all of them locked), so a huge pmd cannot materialize from
+	 * under us.
 	 */
-	split_huge_page_pmd(mm, pmd);
+	split_huge_page_pmd(vma, address, pmd);
+}
+
+/*
+ * Split the huge pmds of a file vma that is becoming nonlinear; once it
+ * is, shmem_pmd_fault() no longer maps huge pmds into it.
+ */
+void split_huge_page_vma(struct vm_area_struct *vma)
+{
+	unsigned long address;
+
+	if (!vma->vm_ops || !vma->vm_ops->pmd_fault)
+		return;
+	address = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
+	for (; address + HPAGE_PMD_SIZE <= vma->vm_end;
+	     address += HPAGE_PMD_SIZE)
+		split_huge_page_address(vma, address);
 }
 
 void __vma_adjust_trans_huge(struct vm_area_struct *vma,
@@ -2434,7 +2766,7 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 	if (start & ~HPAGE_PMD_MASK &&
 	    (start & HPAGE_PMD_MASK) >= vma->vm_start &&
 	    (start & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
-		split_huge_page_address(vma->vm_mm, start);
+		split_huge_page_address(vma, start);
 
 	/*
 	 * If the new end address isn't hpage aligned and it could
@@ -2444,7 +2776,7 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 	if (end & ~HPAGE_PMD_MASK &&
 	    (end & HPAGE_PMD_MASK) >= vma->vm_start &&
 	    (end & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= vma->vm_end)
-		split_huge_page_address(vma->vm_mm, end);
+		split_huge_page_address(vma, end);
 
 	/*
 	 * If we're also updating the vma->vm_next->vm_start, if the new
@@ -2458,6 +2790,6 @@ void __vma_adjust_trans_huge(struct vm_area_struct *vma,
 		if (nstart & ~HPAGE_PMD_MASK &&
 		    (nstart & HPAGE_PMD_MASK) >= next->vm_start &&
 		    (nstart & HPAGE_PMD_MASK) + HPAGE_PMD_SIZE <= next->vm_end)
-			split_huge_page_address(next->vm_mm, nstart);
+			split_huge_page_address(next, nstart);
 	}
 }
@@ -36,6 +36,8 @@
 #include <linux/hash.h>
 #include <linux/freezer.h>
 #include <linux/oom.h>
+#include <linux/vmalloc.h>
+#include <linux/numa.h>
 
 #include <asm/tlbflush.h>
 #include "internal.h"
@@ -78,6 +80,16 @@
  *    take 10 attempts to find a page in the unstable tree, once it is found,
  *    it is secured in the stable tree.  (When we scan a new page, we first
  *    compare it against the stable tree, and then against the unstable tree.)
+ *
+ * Unless merge_across_nodes is set, there is one stable and one unstable
+ * tree per NUMA node, and pages are only merged with pages on their own
+ * node: so that a process is not left accessing remote memory just because
+ * its page happened to have the same content as another node's page.
+ *
+ * Most pages scanned do not match anything in the stable tree, yet each
+ * used to cost a memcmp at every level of its descent.  A counting filter,
+ * indexed by the checksum of each stable page, lets those pages skip the
+ * stable tree altogether.
  */
 
 /**
@@ -113,13 +125,25 @@ struct ksm_scan {
 /**
  * struct stable_node - node of the stable rbtree
  * @node: rb node of this ksm page in the stable tree
+ * @head: (overlaying parent) &migrate_nodes indicates temporarily on that list
+ * @list: linked into migrate_nodes, pending placement in the proper node tree
  * @hlist: hlist head of rmap_items using this ksm page
  * @kpfn: page frame number of this ksm page
+ * @checksum: checksum of this ksm page, as counted in the stable filter
+ * @nid: NUMA node id of the stable tree in which linked
  */
 struct stable_node {
-	struct rb_node node;
+	union {
+		struct rb_node node;	/* when node of stable tree */
+		struct {		/* when listed for migration */
+			struct list_head *head;
+			struct list_head list;
+		};
+	};
 	struct hlist_head hlist;
 	unsigned long kpfn;
+	u32 checksum;
+	int nid;
 };
 
 /**
@@ -129,6 +153,7 @@ struct stable_node {
  * @mm: the memory structure this rmap_item is pointing into
  * @address: the virtual address this rmap_item tracks (+ flags in low bits)
  * @oldchecksum: previous checksum of the page at that virtual address
+ * @nid: NUMA node id of the unstable tree in which linked
  * @node: rb node of this rmap_item in the unstable tree
  * @head: pointer to stable_node heading this list in the stable tree
  * @hlist: link into hlist of rmap_items hanging off that stable_node
@@ -139,6 +164,7 @@ struct rmap_item {
 	struct mm_struct *mm;
 	unsigned long address;		/* + low bits used for flags below */
 	unsigned int oldchecksum;	/* when unstable */
+	int nid;			/* when node of unstable tree */
 	union {
 		struct rb_node node;	/* when node of unstable tree */
 		struct {		/* when listed from stable tree */
@@ -152,9 +178,17 @@ struct rmap_item {
 #define UNSTABLE_FLAG	0x100	/* is a node of the unstable tree */
 #define STABLE_FLAG	0x200	/* is listed from the stable tree */
 
-/* The stable and unstable tree heads */
-static struct rb_root root_stable_tree = RB_ROOT;
-static struct rb_root root_unstable_tree = RB_ROOT;
+/* The stable and unstable tree heads, one of each per NUMA node */
+static struct rb_root root_stable_tree[MAX_NUMNODES];
+static struct rb_root root_unstable_tree[MAX_NUMNODES];
+
+/* Stable nodes of ksm pages migrated off the node of their stable tree */
+static LIST_HEAD(migrate_nodes);
+
+/* Counting filter over stable page checksums, NULL if not allocated */
+#define STABLE_FILTER_MAX	0xff	/* saturated: never decremented */
+static u8 *stable_filter;
+static unsigned int stable_filter_shift;
 
 #define MM_SLOTS_HASH_SHIFT 10
 #define MM_SLOTS_HASH_HEADS (1 << MM_SLOTS_HASH_SHIFT)
@@ -189,6 +223,9 @@ static unsigned int ksm_thread_pages_to_scan = 100;
 /* Milliseconds ksmd should sleep between batches */
 static unsigned int ksm_thread_sleep_millisecs = 20;
 
+/* Zero to keep merged pages on the NUMA node of the pages they replace */
+static unsigned int ksm_merge_across_nodes = 1;
+
 #define KSM_RUN_STOP	0
 #define KSM_RUN_MERGE	1
 #define KSM_RUN_UNMERGE	2
@@ -443,6 +480,50 @@ out:		page = NULL;
 	return page;
 }
 
+/*
+ * Which of the per-node trees a page belongs in: all share tree 0 when
+ * merge_across_nodes is set.
+ */
+static inline int get_kpfn_nid(unsigned long kpfn)
+{
+	return ksm_merge_across_nodes ? 0 : pfn_to_nid(kpfn);
+}
+
+static inline u8 *stable_filter_slot(u32 checksum)
+{
+	return &stable_filter[hash_32(checksum, stable_filter_shift)];
+}
+
+static void stable_filter_add(u32 checksum)
+{
+	u8 *slot;
+
+	if (!stable_filter)
+		return;
+	slot = stable_filter_slot(checksum);
+	if (*slot < STABLE_FILTER_MAX)
+		(*slot)++;
+}
+
+static void stable_filter_del(u32 checksum)
+{
+	u8 *slot;
+
+	if (!stable_filter)
+		return;
+	slot = stable_filter_slot(checksum);
+	if (*slot < STABLE_FILTER_MAX)
+		(*slot)--;
+}
+
+/*
+ * Returns false only if no page in the stable trees has this checksum.
+ */
+static inline bool stable_filter_test(u32 checksum)
+{
+	return !stable_filter || *stable_filter_slot(checksum);
+}
+
 static void remove_node_from_stable_tree(struct stable_node *stable_node)
 {
 	struct rmap_item *rmap_item;
@@ -458,10 +539,28 @@ static void remove_node_from_stable_tree(struct stable_node *stable_node)
 		cond_resched();
 	}
 
-	rb_erase(&stable_node->node, &root_stable_tree);
+	stable_filter_del(stable_node->checksum);
+	if (stable_node->head == &migrate_nodes)
+		list_del(&stable_node->list);
+	else
+		rb_erase(&stable_node->node,
+			 &root_stable_tree[stable_node->nid]);
 	free_stable_node(stable_node);
 }
 
+/*
+ * A ksm page migrated to another node must leave the stable tree of its
+ * old node, or pages of that node would go on being merged with it.  Its
+ * stable node waits on migrate_nodes until a scan of one of its mappings
+ * finds it a place in the tree of its new node, in stable_tree_search().
+ */
+static void migrate_stable_node(struct stable_node *stable_node)
+{
+	rb_erase(&stable_node->node, &root_stable_tree[stable_node->nid]);
+	stable_node->head = &migrate_nodes;
+	list_add(&stable_node->list, stable_node->head);
+}
+
 /*
  * get_ksm_page: checks if the page indicated by the stable node
  * is still its ksm page, despite having held no reference to it.
@@ -556,7 +655,8 @@ static void remove_rmap_item_from_tree(struct rmap_item *rmap_item)
 		age = (unsigned char)(ksm_scan.seqnr - rmap_item->address);
 		BUG_ON(age > 1);
 		if (!age)
-			rb_erase(&rmap_item->node, &root_unstable_tree);
+			rb_erase(&rmap_item->node,
+				 &root_unstable_tree[rmap_item->nid]);
 
 		ksm_pages_unshared--;
 		rmap_item->address &= PAGE_MASK;
@@ -610,6 +710,64 @@ static int unmerge_ksm_pages(struct vm_area_struct *vma,
 /*
  * Only called through the sysfs control interface:
  */
+static int remove_stable_node(struct stable_node *stable_node)
+{
+	struct page *page;
+	int err;
+
+	page = get_ksm_page(stable_node);
+	if (!page) {
+		/* get_ksm_page did remove_node_from_stable_tree itself */
+		return 0;
+	}
+
+	lock_page(page);
+	if (WARN_ON_ONCE(page_mapped(page))) {
+		/*
+		 * This should not happen: but if it does, just refuse to
+		 * let merge_across_nodes be switched - no need to panic.
+		 */
+		err = -EBUSY;
+	} else {
+		/*
+		 * The page is unmapped but not yet freed: it may be in a
+		 * pagevec, or in swapcache.  get_ksm_page() still sees it
+		 * as a ksm page, but nothing can find it through the node.
+		 */
+		set_page_stable_node(page, NULL);
+		remove_node_from_stable_tree(stable_node);
+		err = 0;
+	}
+	unlock_page(page);
+	put_page(page);
+	return err;
+}
+
+static int remove_all_stable_nodes(void)
+{
+	struct stable_node *stable_node, *next;
+	int nid;
+	int err = 0;
+
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		while (root_stable_tree[nid].rb_node) {
+			stable_node = rb_entry(root_stable_tree[nid].rb_node,
+					       struct stable_node, node);
+			if (remove_stable_node(stable_node)) {
+				err = -EBUSY;
+				break;	/* proceed to next nid */
+			}
+			cond_resched();
+		}
+	}
+	list_for_each_entry_safe(stable_node, next, &migrate_nodes, list) {
+		if (remove_stable_node(stable_node))
+			err = -EBUSY;
+		cond_resched();
+	}
+	return err;
+}
+
 static int unmerge_and_remove_all_rmap_items(void)
 {
 	struct mm_slot *mm_slot;
@@ -657,6 +815,8 @@ static int unmerge_and_remove_all_rmap_items(void)
 		}
 	}
 
+	/* Clean up stable nodes, but don't worry if some are still busy */
+	remove_all_stable_nodes();
 	ksm_scan.seqnr = 0;
 	return 0;
 
@@ -891,6 +1051,12 @@ static int try_to_merge_one_page(struct vm_area_struct *vma,
 			 */
 			set_page_stable_node(page, NULL);
 			mark_page_accessed(page);
+			/*
+			 * Its ptes are clean now: keep reclaim from taking
+			 * a MADV_FREE page for one nobody wants back.
+			 */
+			if (!PageSwapBacked(page))
+				SetPageDirty(page);
 			err = 0;
 		} else if (pages_identical(page, kpage))
 			err = replace_page(vma, page, kpage, orig_pte);
@@ -978,45 +1144,90 @@ static struct page *try_to_merge_two_pages(struct rmap_item *rmap_item,
  * stable_tree_search - search for page inside the stable tree
  *
  * This function checks if there is a page inside the stable tree
- * with identical content to the page that we are scanning right now.
+ * with identical content to the page that we are scanning right now;
+ * @checksum is the page's current checksum, used to skip the search
+ * when the stable filter shows that nothing can match.
  *
  * This function returns the stable tree node of identical content if found,
  * NULL otherwise.
  */
-static struct page *stable_tree_search(struct page *page)
+static struct page *stable_tree_search(struct page *page, u32 checksum)
 {
-	struct rb_node *node = root_stable_tree.rb_node;
+	struct rb_root *root;
+	struct rb_node **new;
+	struct rb_node *parent;
 	struct stable_node *stable_node;
+	struct stable_node *page_node;
+	int nid;
 
-	stable_node = page_stable_node(page);
-	if (stable_node) {			/* ksm page forked */
+	page_node = page_stable_node(page);
+	if (page_node && page_node->head != &migrate_nodes) {
+		/* ksm page forked */
 		get_page(page);
 		return page;
 	}
 
-	while (node) {
+	/* A migrated ksm page is counted in the filter already */
+	if (!page_node && !stable_filter_test(checksum))
+		return NULL;
+
+	nid = get_kpfn_nid(page_to_pfn(page));
+	root = &root_stable_tree[nid];
+again:
+	new = &root->rb_node;
+	parent = NULL;
+
+	while (*new) {
 		struct page *tree_page;
 		int ret;
 
 		cond_resched();
-		stable_node = rb_entry(node, struct stable_node, node);
+		stable_node = rb_entry(*new, struct stable_node, node);
 		tree_page = get_ksm_page(stable_node);
-		if (!tree_page)
+		if (!tree_page) {
+			/*
+			 * get_ksm_page() removed a stale node, rebalancing
+			 * the tree: a migrated ksm page still needs its
+			 * place in it, so search again.
+			 */
+			if (page_node)
+				goto again;
 			return NULL;
+		}
 
 		ret = memcmp_pages(page, tree_page);
 
+		parent = *new;
 		if (ret < 0) {
 			put_page(tree_page);
-			node = node->rb_left;
+			new = &parent->rb_left;
 		} else if (ret > 0) {
 			put_page(tree_page);
-			node = node->rb_right;
+			new = &parent->rb_right;
+		} else if (get_kpfn_nid(stable_node->kpfn) != nid) {
+			/* Not a match for this node: that page migrated */
+			put_page(tree_page);
+			migrate_stable_node(stable_node);
+			if (page_node)
+				goto again;
+			return NULL;
 		} else
 			return tree_page;
 	}
 
-	return NULL;
+	if (!page_node)
+		return NULL;
+
+	/*
+	 * Nothing on its new node has the content of this migrated ksm page:
+	 * move its stable node into the tree of that node.
+	 */
+	list_del(&page_node->list);
+	rb_link_node(&page_node->node, parent, new);
+	rb_insert_color(&page_node->node, root);
+	page_node->nid = nid;
+	get_page(page);
+	return page;
 }
 
 /*
@@ -1028,7 +1239,8 @@ static struct page *stable_tree_search(struct page *page)
  */
 static struct stable_node *stable_tree_insert(struct page *kpage)
 {
-	struct rb_node **new = &root_stable_tree.rb_node;
+	int nid = get_kpfn_nid(page_to_pfn(kpage));
+	struct rb_node **new = &root_stable_tree[nid].rb_node;
 	struct rb_node *parent = NULL;
 	struct stable_node *stable_node;
 
@@ -1065,11 +1277,15 @@ static struct stable_node *stable_tree_insert(struct page *kpage)
 		return NULL;
 
 	rb_link_node(&stable_node->node, parent, new);
-	rb_insert_color(&stable_node->node, &root_stable_tree);
+	rb_insert_color(&stable_node->node, &root_stable_tree[nid]);
 
 	INIT_HLIST_HEAD(&stable_node->hlist);
 
 	stable_node->kpfn = page_to_pfn(kpage);
+	stable_node->nid = nid;
+	/* kpage is write-protected now, so its checksum cannot change */
+	stable_node->checksum = calc_checksum(kpage);
+	stable_filter_add(stable_node->checksum);
 	set_page_stable_node(kpage, stable_node);
 
 	return stable_node;
@@ -1095,8 +1311,14 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 					      struct page **tree_pagep)
 
 {
-	struct rb_node **new = &root_unstable_tree.rb_node;
+	struct rb_root *root;
+	struct rb_node **new;
 	struct rb_node *parent = NULL;
+	int nid;
+
+	nid = get_kpfn_nid(page_to_pfn(page));
+	root = &root_unstable_tree[nid];
+	new = &root->rb_node;
 
 	while (*new) {
 		struct rmap_item *tree_rmap_item;
@@ -1117,6 +1339,15 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 			return NULL;
 		}
 
+		/*
+		 * If tree_page has been migrated to another NUMA node since
+		 * it was inserted, stop here rather than merge across nodes.
+		 */
+		if (!ksm_merge_across_nodes && page_to_nid(tree_page) != nid) {
+			put_page(tree_page);
+			return NULL;
+		}
+
 		ret = memcmp_pages(page, tree_page);
 
 		parent = *new;
@@ -1134,8 +1365,9 @@ struct rmap_item *unstable_tree_search_insert(struct rmap_item *rmap_item,
 
 	rmap_item->address |= UNSTABLE_FLAG;
 	rmap_item->address |= (ksm_scan.seqnr & SEQNR_MASK);
+	rmap_item->nid = nid;
 	rb_link_node(&rmap_item->node, parent, new);
-	rb_insert_color(&rmap_item->node, &root_unstable_tree);
+	rb_insert_color(&rmap_item->node, root);
 
 	ksm_pages_unshared++;
 	return NULL;
@@ -1177,10 +1409,26 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	unsigned int checksum;
 	int err;
 
+	/*
+	 * ksm_migrate_page() only updates the kpfn, as it cannot take
+	 * ksm_thread_mutex: move the node out of the tree of the old node
+	 * here, for stable_tree_search() to place it in the right one.
+	 */
+	stable_node = page_stable_node(page);
+	if (stable_node && stable_node->head != &migrate_nodes &&
+	    get_kpfn_nid(stable_node->kpfn) != stable_node->nid)
+		migrate_stable_node(stable_node);
+
 	remove_rmap_item_from_tree(rmap_item);
 
+	/*
+	 * The checksum is needed for the unstable tree below anyway, and
+	 * lets the stable filter rule out most pages without a search.
+	 */
+	checksum = calc_checksum(page);
+
 	/* We first start with searching the page inside the stable tree */
-	kpage = stable_tree_search(page);
+	kpage = stable_tree_search(page, checksum);
 	if (kpage) {
 		err = try_to_merge_with_ksm_page(rmap_item, page, kpage);
 		if (!err) {
@@ -1202,7 +1450,6 @@ static void cmp_and_merge_page(struct page *page, struct rmap_item *rmap_item)
 	 * don't want to insert it in the unstable tree, and we don't want
 	 * to waste our time searching for something identical to it there.
 	 */
-	checksum = calc_checksum(page);
 	if (rmap_item->oldchecksum != checksum) {
 		rmap_item->oldchecksum = checksum;
 		return;
@@ -1278,6 +1525,8 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 	struct mm_slot *slot;
 	struct vm_area_struct *vma;
 	struct rmap_item *rmap_item;
+	struct stable_node *stable_node, *next;
+	int nid;
 
 	if (list_empty(&ksm_mm_head.mm_list))
 		return NULL;
@@ -1296,7 +1545,21 @@ static struct rmap_item *scan_get_next_rmap_item(struct page **page)
 		 */
 		lru_add_drain_all();
 
-		root_unstable_tree = RB_ROOT;
+		/*
+		 * Nodes on migrate_nodes are not reached from the trees,
+		 * so prune those whose page was freed here.
+		 */
+		list_for_each_entry_safe(stable_node, next,
+					 &migrate_nodes, list) {
+			struct page *kpage = get_ksm_page(stable_node);
+
+			if (kpage)
+				put_page(kpage);
+			cond_resched();
+		}
+
+		for (nid = 0; nid < nr_node_ids; nid++)
+			root_unstable_tree[nid] = RB_ROOT;
 
 		spin_lock(&ksm_mmlist_lock);
 		slot = list_entry(slot->mm_list.next, struct mm_slot, mm_list);
@@ -1763,12 +2026,20 @@ void ksm_migrate_page(struct page *newpage, struct page *oldpage)
 static struct stable_node *ksm_check_stable_tree(unsigned long start_pfn,
 						 unsigned long end_pfn)
 {
+	struct stable_node *stable_node;
 	struct rb_node *node;
-
-	for (node = rb_first(&root_stable_tree); node; node = rb_next(node)) {
-		struct stable_node *stable_node;
-
-		stable_node = rb_entry(node, struct stable_node, node);
+	int nid;
+
+	for (nid = 0; nid < nr_node_ids; nid++) {
+		for (node = rb_first(&root_stable_tree[nid]); node;
+		     node = rb_next(node)) {
+			stable_node = rb_entry(node, struct stable_node, node);
+			if (stable_node->kpfn >= start_pfn &&
+			    stable_node->kpfn < end_pfn)
+				return stable_node;
+		}
+	}
+	list_for_each_entry(stable_node, &migrate_nodes, list) {
 		if (stable_node->kpfn >= start_pfn &&
 		    stable_node->kpfn < end_pfn)
 			return stable_node;
@@ -1922,6 +2193,46 @@ static ssize_t run_store(struct kobject *kobj, struct kobj_attribute *attr,
 }
 KSM_ATTR(run);
 
+#ifdef CONFIG_NUMA
+static ssize_t merge_across_nodes_show(struct kobject *kobj,
+				       struct kobj_attribute *attr, char *buf)
+{
+	return sprintf(buf, "%u\n", ksm_merge_across_nodes);
+}
+
+static ssize_t merge_across_nodes_store(struct kobject *kobj,
+				   struct kobj_attribute *attr,
+				   const char *buf, size_t count)
+{
+	int err;
+	unsigned long knob;
+
+	err = strict_strtoul(buf, 10, &knob);
+	if (err)
+		return err;
+	if (knob > 1)
+		return -EINVAL;
+
+	/*
+	 * The stable trees cannot be rearranged while pages are merged:
+	 * unmerge everything first, with "echo 2 >run".  Stale nodes may
+	 * still be left in the trees after that, so remove them all now,
+	 * and refuse the switch if any of them is still in use.
+	 */
+	mutex_lock(&ksm_thread_mutex);
+	if (ksm_merge_across_nodes != knob) {
+		if (ksm_pages_shared || remove_all_stable_nodes())
+			err = -EBUSY;
+		else
+			ksm_merge_across_nodes = knob;
+	}
+	mutex_unlock(&ksm_thread_mutex);
+
+	return err ? err : count;
+}
+KSM_ATTR(merge_across_nodes);
+#endif
+
 static ssize_t pages_shared_show(struct kobject *kobj,
 				 struct kobj_attribute *attr, char *buf)
 {
@@ -1976,6 +2287,9 @@ static struct attribute *ksm_attrs[] = {
 	&pages_unshared_attr.attr,
 	&pages_volatile_attr.attr,
 	&full_scans_attr.attr,
+#ifdef CONFIG_NUMA
+	&merge_across_nodes_attr.attr,
+#endif
 	NULL,
 };
 
@@ -1985,6 +2299,21 @@ static struct attribute_group ksm_attr_group = {
 };
 #endif /* CONFIG_SYSFS */
 
+/*
+ * Size the stable filter at one counter per eight pages of memory: the
+ * filter only helps while most of its counters remain zero.  KSM works
+ * without it, just less efficiently, if it cannot be allocated.
+ */
+static void __init ksm_filter_init(void)
+{
+	unsigned long nr = max(totalram_pages >> 3, 4096UL);
+
+	stable_filter_shift = ilog2(roundup_pow_of_two(nr));
+	stable_filter = vzalloc(1UL << stable_filter_shift);
+	if (!stable_filter)
+		printk(KERN_WARNING "ksm: stable filter allocation failed\n");
+}
+
 static int __init ksm_init(void)
 {
 	struct task_struct *ksm_thread;
@@ -1994,6 +2323,8 @@ static int __init ksm_init(void)
 	if (err)
 		goto out;
 
+	ksm_filter_init();
+
 	ksm_thread = kthread_run(ksm_scan_thread, NULL, "ksmd");
 	if (IS_ERR(ksm_thread)) {
 		printk(KERN_ERR "ksm: creating kthread failed\n");
@@ -2023,6 +2354,8 @@ static int __init ksm_init(void)
 	return 0;
 
 out_free:
+	vfree(stable_filter);
+	stable_filter = NULL;
 	ksm_slab_free();
 out:
 	return err;
@@ -511,7 +511,7 @@ static inline int check_pmd_range(struct vm_area_struct *vma, pud_t *pud,
 	pmd = pmd_offset(pud, addr);
 	do {
 		next = pmd_addr_end(addr, end);
-		split_huge_page_pmd(vma->vm_mm, pmd);
+		split_huge_page_pmd(vma, addr, pmd);
 		if (pmd_none_or_clear_bad(pmd))
 			continue;
 		if (check_pte_range(vma, pmd, addr, next, nodes,
@@ -561,6 +561,163 @@ static inline int check_pgd_range(struct vm_area_struct *vma,
 	return 0;
 }
 
+#ifdef CONFIG_NUMA_BALANCING
+/*
+ * Revoke access to the private anonymous pages mapped in [addr, end) so
+ * that the next touch raises a NUMA hinting fault.  The ptes keep their
+ * pfn and become PROT_NONE; handle_pte_fault() recognises them because
+ * the vma itself is still accessible.
+ */
+static unsigned long change_prot_numa_pte_range(struct vm_area_struct *vma,
+		pmd_t *pmd, unsigned long addr, unsigned long end,
+		pgprot_t newprot)
+{
+	struct mm_struct *mm = vma->vm_mm;
+	unsigned long updated = 0;
+	pte_t *orig_pte;
+	pte_t *pte;
+	spinlock_t *ptl;
+
+	orig_pte = pte = pte_offset_map_lock(mm, pmd, addr, &ptl);
+	arch_enter_lazy_mmu_mode();
+	do {
+		pte_t oldpte = *pte;
+		struct page *page;
+		pte_t ptent;
+
+		if (!pte_present(oldpte))
+			continue;
+		/* Already armed by a previous pass */
+		if (pte_same(oldpte, pte_modify(oldpte, newprot)))
+			continue;
+		page = vm_normal_page(vma, addr, oldpte);
+		if (!page || PageReserved(page) || PageKsm(page) ||
+		    !PageAnon(page))
+			continue;
+
+		ptent = ptep_modify_prot_start(mm, addr, pte);
+		ptent = pte_modify(ptent, newprot);
+		ptep_modify_prot_commit(mm, addr, pte, ptent);
+		updated++;
+	} while (pte++, addr += PAGE_SIZE, addr != end);
+	arch_leave_lazy_mmu_mode();
+	pte_unmap_unlock(orig_pte, ptl);
+	return updated;
+}
+
+static inline unsigned long change_prot_numa_pmd_range(
+		struct vm_area_struct *vma, pud_t *pud,
+		unsigned long addr, unsigned long end, pgprot_t newprot)
+{
+	unsigned long updated = 0;
+	unsigned long next;
+	pmd_t *pmd;
+
+	pmd = pmd_offset(pud, addr);
+	do {
+		pmd_t pmdval = *pmd;
+
+		next = pmd_addr_end(addr, end);
+		/*
+		 * Only mmap_sem is held for read, so a huge pmd may appear
+		 * under us; work on a snapshot and leave huge pages alone
+		 * rather than splitting them just to sample them.
+		 */
+		barrier();
+		if (pmd_none(pmdval) || pmd_trans_huge(pmdval) ||
+		    unlikely(pmd_bad(pmdval)))
+			continue;
+		updated += change_prot_numa_pte_range(vma, pmd, addr, next,
+						      newprot);
+	} while (pmd++, addr = next, addr != end);
+	return updated;
+}
+
+static inline unsigned long change_prot_numa_pud_range(
+		struct vm_area_struct *vma, pgd_t *pgd,
+		unsigned long addr, unsigned long end, pgprot_t newprot)
+{
+	unsigned long updated = 0;
+	unsigned long next;
+	pud_t *pud;
+
+	pud = pud_offset(pgd, addr);
+	do {
+		next = pud_addr_end(addr, end);
+		if (pud_none_or_clear_bad(pud))
+			continue;
+		updated += change_prot_numa_pmd_range(vma, pud, addr, next,
+						      newprot);
+	} while (pud++, addr = next, addr != end);
+	return updated;
+}
+
+/*
+ * Arm NUMA hinting faults on [start, end) of @vma.  The caller holds
+ * mmap_sem for read.  Returns the number of ptes that were changed.
+ */
+unsigned long change_prot_numa(struct vm_area_struct *vma,
+			unsigned long start, unsigned long end)
+{
+	pgprot_t newprot;
+	unsigned long updated = 0;
+	unsigned long addr = start;
+	unsigned long next;
+	pgd_t *pgd;
+
+	newprot = vm_get_page_prot(vma->vm_flags &
+				   ~(VM_READ | VM_WRITE | VM_EXEC));
+
+	BUG_ON(addr >= end);
+	pgd = pgd_offset(vma->vm_mm, addr);
+	do {
+		next = pgd_addr_end(addr, end);
+		if (pgd_none_or_clear_bad(pgd))
+			continue;
+		updated += change_prot_numa_pud_range(vma, pgd, addr, next,
+						      newprot);
+	} while (pgd++, addr = next, addr != end);
+
+	if (updated) {
+		flush_tlb_range(vma, start, end);
+		count_vm_events(NUMA_PTE_UPDATES, updated);
+	}
+	return updated;
+}
+
+/*
+ * mpol_misplaced - check whether the page is on the node the policy wants
+ * @page: page taking a NUMA hinting fault
+ * @vma: vma the fault was taken in
+ * @addr: faulting address
+ *
+ * Only pages governed by the default (local allocation) policy are
+ * considered; an explicit bind, interleave or preferred policy already
+ * states where the application wants its memory.
+ *
+ * Returns the node the page should move to, or -1 if it is fine where
+ * it is.
+ */
+int mpol_misplaced(struct page *page, struct vm_area_struct *vma,
+		   unsigned long addr)
+{
+	struct mempolicy *pol;
+	int curnid = page_to_nid(page);
+	int polnid = -1;
+
+	pol = get_vma_policy(current, vma, addr);
+	if (pol == &default_policy ||
+	    (pol->mode == MPOL_PREFERRED && (pol->flags & MPOL_F_LOCAL)))
+		polnid = numa_node_id();
+	mpol_cond_put(pol);
+
+	if (polnid == curnid ||
+	    (polnid != -1 && !node_isset(polnid, cpuset_current_mems_allowed)))
+		return -1;
+	return polnid;
+}
+#endif /* CONFIG_NUMA_BALANCING */
+
 /*
  * Check if all pages in a range are on a set of nodes.
  * If pagelist != NULL then isolate pages from the LRU and
@@ -1269,6 +1269,31 @@ void free_hot_cold_page_list(struct list_head *list, int cold)
 	}
 }
 
+/**
+ * free_pages_bulk - drop references to a batch of order-0 pages
+ * @nr_pages: the number of pages in @page_array
+ * @page_array: the pages, as allocated by alloc_pages_bulk() or alloc_page()
+ *
+ * The counterpart of alloc_pages_bulk(): pages whose last reference is
+ * dropped go back to the pcp lists together.  The pages must not be on
+ * the LRU or compound.
+ */
+void free_pages_bulk(unsigned long nr_pages, struct page **page_array)
+{
+	LIST_HEAD(list);
+	unsigned long i;
+
+	for (i = 0; i < nr_pages; i++) {
+		struct page *page = page_array[i];
+
+		VM_BUG_ON(PageCompound(page) || PageLRU(page));
+		if (put_page_testzero(page))
+			list_add(&page->lru, &list);
+	}
+	free_hot_cold_page_list(&list, 0);
+}
+EXPORT_SYMBOL(free_pages_bulk);
+
 /*
  * split_page takes a non-compound higher-order page, and splits it into
  * n (1<<order) sub-pages: page[0..n]
@@ -2423,6 +2448,126 @@ __alloc_pages_nodemask(gfp_t gfp_mask, unsigned int order,
 }
 EXPORT_SYMBOL(__alloc_pages_nodemask);
 
+/**
+ * alloc_pages_bulk - allocate a batch of order-0 pages
+ * @gfp_mask: GFP flags for the allocation
+ * @nr_pages: the number of pages wanted
+ * @page_array: array to store the pages in
+ *
+ * For callers such as network drivers refilling receive rings, which would
+ * otherwise call alloc_page() hundreds of times in a row.  While the local
+ * node's preferred zone is comfortably above its low watermark, the pages
+ * are taken straight off this cpu's pcp list with interrupts disabled once,
+ * refilling the list from the buddy lists a batch at a time.  Whatever
+ * that cannot provide is allocated one page at a time through the normal
+ * path, reclaim included.
+ *
+ * Returns the number of pages stored in @page_array, which is less than
+ * @nr_pages only if the normal path failed too.
+ */
+unsigned long alloc_pages_bulk(gfp_t gfp_mask, unsigned long nr_pages,
+			       struct page **page_array)
+{
+	enum zone_type high_zoneidx = gfp_zone(gfp_mask);
+	int migratetype = allocflags_to_migratetype(gfp_mask);
+	int cold = !!(gfp_mask & __GFP_COLD);
+	struct zonelist *zonelist;
+	struct zone *preferred_zone;
+	struct per_cpu_pages *pcp;
+	struct list_head *list;
+	unsigned long flags;
+	unsigned long nr_fast = 0, nr = 0, i;
+
+	gfp_mask &= gfp_allowed_mask;
+	if (!nr_pages)
+		return 0;
+
+	lockdep_trace_alloc(gfp_mask);
+	might_sleep_if(gfp_mask & __GFP_WAIT);
+
+	if (should_fail_alloc_page(gfp_mask, 0) ||
+	    (gfp_mask & (__GFP_WRITE | __GFP_NOFAIL)))
+		goto slowpath;
+
+	zonelist = node_zonelist(numa_node_id(), gfp_mask);
+	if (unlikely(!zonelist->_zonerefs->zone))
+		return 0;
+
+	get_mems_allowed();
+	first_zones_zonelist(zonelist, high_zoneidx,
+			     &cpuset_current_mems_allowed, &preferred_zone);
+	if (!preferred_zone ||
+	    !cpuset_zone_allowed_softwall(preferred_zone, gfp_mask) ||
+	    !zone_watermark_ok(preferred_zone, 0,
+			       low_wmark_pages(preferred_zone) + nr_pages,
+			       zone_idx(preferred_zone), 0)) {
+		put_mems_allowed();
+		goto slowpath;
+	}
+
+	local_irq_save(flags);
+	pcp = &this_cpu_ptr(preferred_zone->pageset)->pcp;
+	list = &pcp->lists[migratetype];
+	while (nr_fast < nr_pages) {
+		struct page *page;
+
+		if (list_empty(list)) {
+			unsigned long refill = 0;
+
+			/*
+			 * One refill for the whole batch, but never beyond
+			 * pcp->high: the other migratetype lists count too.
+			 * If there is no room, the slowpath does the rest.
+			 */
+			if (pcp->count < pcp->high)
+				refill = min_t(unsigned long,
+					       max_t(unsigned long,
+						     nr_pages - nr_fast,
+						     pcp->batch),
+					       pcp->high - pcp->count);
+			if (refill)
+				pcp->count += rmqueue_bulk(preferred_zone, 0,
+						refill, list, migratetype,
+						cold);
+			if (unlikely(list_empty(list)))
+				break;
+		}
+
+		if (cold)
+			page = list_entry(list->prev, struct page, lru);
+		else
+			page = list_entry(list->next, struct page, lru);
+		list_del(&page->lru);
+		pcp->count--;
+
+		page_array[nr_fast++] = page;
+		zone_statistics(preferred_zone, preferred_zone, gfp_mask);
+	}
+	__count_zone_vm_events(PGALLOC, preferred_zone, nr_fast);
+	local_irq_restore(flags);
+	put_mems_allowed();
+
+	/* As in buffered_rmqueue(), bad pages are leaked rather than used */
+	for (i = 0; i < nr_fast; i++) {
+		struct page *page = page_array[i];
+
+		VM_BUG_ON(bad_range(preferred_zone, page));
+		if (prep_new_page(page, 0, gfp_mask))
+			continue;
+		trace_mm_page_alloc(page, 0, gfp_mask, migratetype);
+		page_array[nr++] = page;
+	}
+
+slowpath:
+	for (; nr < nr_pages; nr++) {
+		page_array[nr] = alloc_pages(gfp_mask, 0);
+		if (!page_array[nr])
+			break;
+	}
+	return nr;
+}
+EXPORT_SYMBOL(alloc_pages_bulk);
+
 /*
  * Common helper functions.
  */
@@ -4257,6 +4402,9 @@ static void __paginginit free_area_init_core(struct pglist_data *pgdat,
 	pgdat->nr_zones = 0;
 	init_waitqueue_head(&pgdat->kswapd_wait);
 	pgdat->kswapd_max_order = 0;
+#ifdef CONFIG_COMPACTION
+	init_waitqueue_head(&pgdat->kcompactd_wait);
+#endif
 	pgdat_page_cgroup_init(pgdat);
 	
 	for (j = 0; j < MAX_NR_ZONES; j++) {
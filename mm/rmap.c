@@ -729,6 +729,33 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 		pte_t *pte;
 		spinlock_t *ptl;
 
+		/*
+		 * A shmem page may be mapped by a huge pmd, whose young
+		 * bit then stands for all the pages it maps: see
+		 * do_huge_pmd_file_page().
+		 */
+		if (!PageAnon(page) && vma->vm_ops && vma->vm_ops->pmd_fault) {
+			pmd_t *pmd;
+
+			spin_lock(&mm->page_table_lock);
+			pmd = page_check_address_file_pmd(page, mm, address);
+			if (pmd) {
+				if (vma->vm_flags & VM_LOCKED) {
+					spin_unlock(&mm->page_table_lock);
+					*mapcount = 0;	/* break early from loop */
+					*vm_flags |= VM_LOCKED;
+					goto out;
+				}
+				if (pmdp_clear_flush_young_notify(vma,
+						address & HPAGE_PMD_MASK, pmd) &&
+				    likely(!VM_SequentialReadHint(vma)))
+					referenced++;
+				spin_unlock(&mm->page_table_lock);
+				goto mapped;
+			}
+			spin_unlock(&mm->page_table_lock);
+		}
+
 		/*
 		 * rmap might return false positives; we must filter
 		 * these out using page_check_address().
@@ -758,6 +785,7 @@ int page_referenced_one(struct page *page, struct vm_area_struct *vma,
 		pte_unmap_unlock(pte, ptl);
 	}
 
+mapped:
 	/* Pretend the page is referenced if the task has the
 	   swap token and is in the middle of a page fault. */
 	if (mm != current->mm && has_swap_token(mm) &&
@@ -1220,6 +1248,10 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	spinlock_t *ptl;
 	int ret = SWAP_AGAIN;
 
+	/* a huge pmd may map this shmem page, see do_huge_pmd_file_page() */
+	if (!PageAnon(page) && vma->vm_ops && vma->vm_ops->pmd_fault)
+		split_huge_page_address(vma, address);
+
 	pte = page_check_address(page, mm, address, &ptl, 0);
 	if (!pte)
 		goto out;
@@ -1282,6 +1314,20 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 			}
 			dec_mm_counter(mm, MM_ANONPAGES);
 			inc_mm_counter(mm, MM_SWAPENTS);
+		} else if (!PageSwapBacked(page) &&
+			   TTU_ACTION(flags) == TTU_UNMAP) {
+			/*
+			 * MADV_FREE page: drop it, unless it has been
+			 * written to since, which the dirty bit moved
+			 * above tells.
+			 */
+			if (PageDirty(page)) {
+				set_pte_at(mm, address, pte, pteval);
+				ret = SWAP_FAIL;
+				goto out_unmap;
+			}
+			dec_mm_counter(mm, MM_ANONPAGES);
+			goto discard;
 		} else if (PAGE_MIGRATION) {
 			/*
 			 * Store the pfn of the page in a special migration
@@ -1301,6 +1347,7 @@ int try_to_unmap_one(struct page *page, struct vm_area_struct *vma,
 	} else
 		dec_mm_counter(mm, MM_FILEPAGES);
 
+discard:
 	page_remove_rmap(page);
 	page_cache_release(page);
 
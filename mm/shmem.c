@@ -30,6 +30,7 @@
 #include <linux/mm.h>
 #include <linux/export.h>
 #include <linux/swap.h>
+#include <linux/khugepaged.h>
 
 static struct vfsmount *shm_mnt;
 
@@ -89,8 +90,27 @@ enum sgp_type {
 	SGP_CACHE,	/* don't exceed i_size, may allocate page */
 	SGP_DIRTY,	/* like SGP_CACHE, but set new page dirty */
 	SGP_WRITE,	/* may exceed i_size, may allocate page */
+	SGP_HUGE,	/* like SGP_CACHE, but may allocate a huge team */
 };
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+/*
+ * Huge page policy: set per mount by the huge= option, and for the
+ * internal mount (SysV shm and shared anonymous) by shmem_enabled in
+ * /sys/kernel/mm/transparent_hugepage.  SHMEM_HUGE_DENY and
+ * SHMEM_HUGE_FORCE are only accepted by that sysfs file: they override
+ * the policy of every mount, for testing and for emergencies.
+ */
+#define SHMEM_HUGE_NEVER	0
+#define SHMEM_HUGE_ALWAYS	1
+#define SHMEM_HUGE_WITHIN_SIZE	2
+#define SHMEM_HUGE_ADVISE	3
+#define SHMEM_HUGE_DENY		(-1)
+#define SHMEM_HUGE_FORCE	(-2)
+
+static int shmem_huge __read_mostly;
+#endif
+
 #ifdef CONFIG_TMPFS
 static unsigned long shmem_default_max_blocks(void)
 {
@@ -139,13 +159,14 @@ static inline void shmem_unacct_size(unsigned long flags, loff_t size)
 /*
  * ... whereas tmpfs objects are accounted incrementally as
  * pages are allocated, in order to allow huge sparse files.
- * shmem_getpage reports shmem_acct_block failure as -ENOSPC not -ENOMEM,
+ * shmem_getpage reports shmem_acct_blocks failure as -ENOSPC not -ENOMEM,
  * so that a failure on a sparse tmpfs mapping will give SIGBUS not OOM.
  */
-static inline int shmem_acct_block(unsigned long flags)
+static inline int shmem_acct_blocks(unsigned long flags, long pages)
 {
 	return (flags & VM_NORESERVE) ?
-		security_vm_enough_memory_kern(VM_ACCT(PAGE_CACHE_SIZE)) : 0;
+		security_vm_enough_memory_kern(pages *
+					VM_ACCT(PAGE_CACHE_SIZE)) : 0;
 }
 
 static inline void shmem_unacct_blocks(unsigned long flags, long pages)
@@ -855,6 +876,244 @@ static inline struct mempolicy *shmem_get_sbmpol(struct shmem_sb_info *sbinfo)
 }
 #endif
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+#if defined(CONFIG_SYSFS) || defined(CONFIG_TMPFS)
+static int shmem_parse_huge(const char *str)
+{
+	if (!strcmp(str, "never"))
+		return SHMEM_HUGE_NEVER;
+	if (!strcmp(str, "always"))
+		return SHMEM_HUGE_ALWAYS;
+	if (!strcmp(str, "within_size"))
+		return SHMEM_HUGE_WITHIN_SIZE;
+	if (!strcmp(str, "advise"))
+		return SHMEM_HUGE_ADVISE;
+	if (!strcmp(str, "deny"))
+		return SHMEM_HUGE_DENY;
+	if (!strcmp(str, "force"))
+		return SHMEM_HUGE_FORCE;
+	return -EINVAL;
+}
+
+static const char *shmem_format_huge(int huge)
+{
+	switch (huge) {
+	case SHMEM_HUGE_NEVER:
+		return "never";
+	case SHMEM_HUGE_ALWAYS:
+		return "always";
+	case SHMEM_HUGE_WITHIN_SIZE:
+		return "within_size";
+	case SHMEM_HUGE_ADVISE:
+		return "advise";
+	case SHMEM_HUGE_DENY:
+		return "deny";
+	case SHMEM_HUGE_FORCE:
+		return "force";
+	default:
+		VM_BUG_ON(1);
+		return "bad_val";
+	}
+}
+#endif /* CONFIG_SYSFS || CONFIG_TMPFS */
+
+static int shmem_huge_policy(struct inode *inode)
+{
+	if (shmem_huge < 0)
+		return shmem_huge;
+	return SHMEM_SB(inode->i_sb)->huge;
+}
+
+/*
+ * A team is HPAGE_PMD_NR naturally aligned small pages, allocated
+ * together and inserted into the page cache at an aligned index, so
+ * that they can be mapped by a huge pmd.  The pages are not compound:
+ * page cache, reclaim and truncation treat each one individually.
+ */
+static bool shmem_team_within_size(struct inode *inode, pgoff_t start)
+{
+	pgoff_t end = DIV_ROUND_UP(i_size_read(inode), PAGE_CACHE_SIZE);
+
+	return start + HPAGE_PMD_NR <= end;
+}
+
+/* Whether read, write and the pte fault may allocate a team for index */
+static bool shmem_huge_allowed(struct inode *inode, pgoff_t index)
+{
+	switch (shmem_huge_policy(inode)) {
+	case SHMEM_HUGE_FORCE:
+	case SHMEM_HUGE_ALWAYS:
+		return true;
+	case SHMEM_HUGE_WITHIN_SIZE:
+		return shmem_team_within_size(inode,
+				index & ~(pgoff_t)(HPAGE_PMD_NR - 1));
+	default:
+		return false;
+	}
+}
+
+/* Whether vma may be mapped by huge pmds: for pmd_fault and khugepaged */
+bool shmem_huge_enabled(struct vm_area_struct *vma)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	unsigned long haddr;
+
+	if (!(vma->vm_flags & VM_SHARED) ||
+	    (vma->vm_flags & (VM_NOHUGEPAGE | VM_NONLINEAR)))
+		return false;
+	/* A huge pmd must map a team at an aligned index */
+	if (((vma->vm_start >> PAGE_SHIFT) - vma->vm_pgoff) &
+	    (HPAGE_PMD_NR - 1))
+		return false;
+	haddr = (vma->vm_start + ~HPAGE_PMD_MASK) & HPAGE_PMD_MASK;
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end)
+		return false;
+
+	switch (shmem_huge_policy(inode)) {
+	case SHMEM_HUGE_FORCE:
+	case SHMEM_HUGE_ALWAYS:
+	case SHMEM_HUGE_WITHIN_SIZE:
+		return true;
+	case SHMEM_HUGE_ADVISE:
+		return !!(vma->vm_flags & VM_HUGEPAGE);
+	default:
+		return false;
+	}
+}
+
+static struct page *shmem_alloc_hugepage(gfp_t gfp,
+			struct shmem_inode_info *info, pgoff_t index)
+{
+#ifdef CONFIG_NUMA
+	struct vm_area_struct pvma;
+#endif
+
+	/* Fall back to small pages rather than reclaim hard for a team */
+	gfp |= __GFP_NOMEMALLOC | __GFP_NORETRY | __GFP_NOWARN |
+		__GFP_NO_KSWAPD;
+#ifdef CONFIG_NUMA
+	/* Create a pseudo vma that just contains the policy */
+	pvma.vm_start = 0;
+	pvma.vm_pgoff = index;
+	pvma.vm_ops = NULL;
+	pvma.vm_policy = mpol_shared_policy_lookup(&info->policy, index);
+
+	return alloc_pages_vma(gfp, HPAGE_PMD_ORDER, &pvma, 0, numa_node_id());
+#else
+	return alloc_pages(gfp, HPAGE_PMD_ORDER);
+#endif
+}
+
+/*
+ * shmem_alloc_team - allocate a team covering index, if its range is empty
+ *
+ * Returns 0 when the team has been added to the page cache, unlocked:
+ * the caller then looks up index again.  Otherwise the caller falls
+ * back to allocating a small page.
+ */
+static int shmem_alloc_team(struct inode *inode, pgoff_t index, gfp_t gfp)
+{
+	struct address_space *mapping = inode->i_mapping;
+	struct shmem_inode_info *info = SHMEM_I(inode);
+	struct shmem_sb_info *sbinfo = SHMEM_SB(inode->i_sb);
+	pgoff_t start = index & ~(pgoff_t)(HPAGE_PMD_NR - 1);
+	unsigned long found;
+	struct page *page;
+	void **slot;
+	int error;
+	int i;
+
+	/* Only fill a range holding neither pages nor swap entries */
+	rcu_read_lock();
+	i = radix_tree_gang_lookup_slot(&mapping->page_tree,
+					&slot, &found, start, 1);
+	rcu_read_unlock();
+	if (i && found < start + HPAGE_PMD_NR)
+		return -EEXIST;
+
+	if (shmem_acct_blocks(info->flags, HPAGE_PMD_NR))
+		return -ENOSPC;
+	if (sbinfo->max_blocks) {
+		if (sbinfo->max_blocks < HPAGE_PMD_NR ||
+		    percpu_counter_compare(&sbinfo->used_blocks,
+				sbinfo->max_blocks - HPAGE_PMD_NR + 1) >= 0) {
+			error = -ENOSPC;
+			goto unacct;
+		}
+		percpu_counter_add(&sbinfo->used_blocks, HPAGE_PMD_NR);
+	}
+
+	page = shmem_alloc_hugepage(gfp, info, start);
+	if (!page) {
+		error = -ENOMEM;
+		goto decused;
+	}
+	split_page(page, HPAGE_PMD_ORDER);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		SetPageSwapBacked(page + i);
+		__set_page_locked(page + i);
+		clear_highpage(page + i);
+		flush_dcache_page(page + i);
+		SetPageUptodate(page + i);
+	}
+
+	/*
+	 * Insert one page at a time: a racing lookup may find part of the
+	 * team, but only locked, so it waits until we are done or undone.
+	 */
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		error = mem_cgroup_cache_charge(page + i, current->mm,
+						gfp & GFP_RECLAIM_MASK);
+		if (!error)
+			error = shmem_add_to_page_cache(page + i, mapping,
+						start + i, gfp, NULL);
+		if (error)
+			break;
+	}
+	if (error) {
+		while (i--)
+			delete_from_page_cache(page + i);
+		for (i = 0; i < HPAGE_PMD_NR; i++) {
+			unlock_page(page + i);
+			page_cache_release(page + i);
+		}
+		goto decused;
+	}
+
+	spin_lock(&info->lock);
+	info->alloced += HPAGE_PMD_NR;
+	inode->i_blocks += HPAGE_PMD_NR * BLOCKS_PER_PAGE;
+	shmem_recalc_inode(inode);
+	spin_unlock(&info->lock);
+
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		lru_cache_add_anon(page + i);
+		unlock_page(page + i);
+		page_cache_release(page + i);
+	}
+	return 0;
+
+decused:
+	if (sbinfo->max_blocks)
+		percpu_counter_add(&sbinfo->used_blocks, -HPAGE_PMD_NR);
+unacct:
+	shmem_unacct_blocks(info->flags, HPAGE_PMD_NR);
+	return error;
+}
+#else /* !CONFIG_TRANSPARENT_HUGEPAGE */
+static inline bool shmem_huge_allowed(struct inode *inode, pgoff_t index)
+{
+	return false;
+}
+
+static inline int shmem_alloc_team(struct inode *inode, pgoff_t index,
+				   gfp_t gfp)
+{
+	return -EINVAL;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 /*
  * shmem_getpage_gfp - find page in cache, or get from swap, or allocate
  *
@@ -909,7 +1168,7 @@ repeat:
 
 	if (swap.val) {
 		/* Look it up and read it in.. */
-		page = lookup_swap_cache(swap);
+		page = lookup_swap_cache(swap, NULL, 0);
 		if (!page) {
 			/* here we actually do the io */
 			if (fault_type)
@@ -956,7 +1215,13 @@ repeat:
 		swap_free(swap);
 
 	} else {
-		if (shmem_acct_block(info->flags)) {
+		if ((sgp == SGP_HUGE ||
+		     ((sgp == SGP_CACHE || sgp == SGP_WRITE) &&
+		      shmem_huge_allowed(inode, index))) &&
+		    !shmem_alloc_team(inode, index, gfp))
+			goto repeat;
+
+		if (shmem_acct_blocks(info->flags, 1)) {
 			error = -ENOSPC;
 			goto failed;
 		}
@@ -1065,6 +1330,193 @@ static int shmem_fault(struct vm_area_struct *vma, struct vm_fault *vmf)
 	return ret;
 }
 
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+static int shmem_pmd_fault(struct vm_area_struct *vma, unsigned long address,
+			   pmd_t *pmd, unsigned int flags)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	unsigned long haddr = address & HPAGE_PMD_MASK;
+	struct page *page, *subpage;
+	pgoff_t index;
+	int error;
+	int ret = 0;
+	int i;
+
+	if (haddr < vma->vm_start || haddr + HPAGE_PMD_SIZE > vma->vm_end ||
+	    !shmem_huge_enabled(vma))
+		return VM_FAULT_FALLBACK;
+	/* Never map beyond i_size with a huge pmd: that must SIGBUS */
+	index = linear_page_index(vma, haddr);
+	if (!shmem_team_within_size(inode, index))
+		return VM_FAULT_FALLBACK;
+	if (unlikely(khugepaged_enter_vma_merge(vma)))
+		return VM_FAULT_OOM;
+
+	error = shmem_getpage(inode, index, &page, SGP_HUGE, &ret);
+	if (error)
+		return VM_FAULT_FALLBACK;
+
+	/* Holding every page of the team locked keeps truncation away */
+	i = 1;
+	if (!(page_to_pfn(page) & (HPAGE_PMD_NR - 1))) {
+		for (; i < HPAGE_PMD_NR; i++) {
+			subpage = find_lock_page(inode->i_mapping, index + i);
+			if (subpage == page + i)
+				continue;
+			if (subpage && !radix_tree_exceptional_entry(subpage)) {
+				unlock_page(subpage);
+				page_cache_release(subpage);
+			}
+			break;
+		}
+	}
+
+	/* Perhaps the file has been truncated since we checked */
+	if (i == HPAGE_PMD_NR && shmem_team_within_size(inode, index))
+		ret |= do_huge_pmd_file_page(vma->vm_mm, vma, haddr, pmd,
+					     page, flags);
+	else
+		ret = VM_FAULT_FALLBACK;
+
+	while (i--) {
+		unlock_page(page + i);
+		page_cache_release(page + i);
+	}
+	if (ret & VM_FAULT_FALLBACK)
+		return ret;
+
+	if (flags & FAULT_FLAG_WRITE)
+		file_update_time(vma->vm_file);
+	if (ret & VM_FAULT_MAJOR) {
+		count_vm_event(PGMAJFAULT);
+		mem_cgroup_count_vm_event(vma->vm_mm, PGMAJFAULT);
+	}
+	return ret;
+}
+
+/**
+ * shmem_collapse_huge_page - gather the pages at address into a team
+ * @vma: shmem vma, mmap_sem held for read
+ * @address: huge page aligned address in vma
+ * @max_none: how many holes in the range may be filled
+ *
+ * Called by khugepaged: copies the pages backing the huge page range
+ * at address into a newly allocated team, replacing them in the page
+ * cache.  They are unmapped first, from every vma, and the copy is
+ * abandoned if anyone else still holds a reference.  Returns 0 once
+ * the range is backed by a team, for the next fault to map it with a
+ * huge pmd.
+ */
+int shmem_collapse_huge_page(struct vm_area_struct *vma,
+			     unsigned long address, unsigned int max_none)
+{
+	struct inode *inode = vma->vm_file->f_path.dentry->d_inode;
+	struct address_space *mapping = inode->i_mapping;
+	pgoff_t start = linear_page_index(vma, address);
+	struct page *page, *head = NULL, *new;
+	struct page **pages;
+	unsigned int none = 0;
+	int team = 1;
+	int error = 0;
+	int nr, replaced, i;
+
+	VM_BUG_ON(start & (HPAGE_PMD_NR - 1));
+	if (!shmem_team_within_size(inode, start))
+		return -EINVAL;
+
+	rcu_read_lock();
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		page = radix_tree_lookup(&mapping->page_tree, start + i);
+		if (!page) {
+			none++;
+			team = 0;
+			continue;
+		}
+		/* Like khugepaged_scan_pmd, leave swapped out ranges alone */
+		if (radix_tree_exceptional_entry(page)) {
+			error = -EAGAIN;
+			break;
+		}
+		if (!i)
+			head = page;
+		else if (page != head + i)
+			team = 0;
+	}
+	rcu_read_unlock();
+	if (error || none > max_none)
+		return -EAGAIN;
+	if (team && !(page_to_pfn(head) & (HPAGE_PMD_NR - 1)))
+		return 0;
+
+	pages = kmalloc(HPAGE_PMD_NR * sizeof(struct page *), GFP_KERNEL);
+	if (!pages)
+		return -ENOMEM;
+	new = shmem_alloc_hugepage(mapping_gfp_mask(mapping),
+				   SHMEM_I(inode), start);
+	if (!new) {
+		kfree(pages);
+		return -ENOMEM;
+	}
+	split_page(new, HPAGE_PMD_ORDER);
+
+	/* Lock the whole range, filling holes, in index order */
+	for (nr = 0; nr < HPAGE_PMD_NR; nr++) {
+		error = shmem_getpage(inode, start + nr, &pages[nr],
+				      SGP_CACHE, NULL);
+		if (error)
+			break;
+	}
+
+	if (!error) {
+		lru_add_drain();
+		unmap_mapping_range(mapping, (loff_t)start << PAGE_CACHE_SHIFT,
+				    HPAGE_PMD_SIZE, 0);
+		/* Only the page cache and we may hold a reference */
+		for (i = 0; i < HPAGE_PMD_NR; i++) {
+			if (page_mapped(pages[i]) ||
+			    page_count(pages[i]) != 2) {
+				error = -EAGAIN;
+				break;
+			}
+		}
+	}
+
+	replaced = 0;
+	if (!error) {
+		for (; replaced < HPAGE_PMD_NR; replaced++) {
+			page = new + replaced;
+			copy_highpage(page, pages[replaced]);
+			SetPageSwapBacked(page);
+			SetPageUptodate(page);
+			if (PageDirty(pages[replaced]))
+				SetPageDirty(page);
+			__set_page_locked(page);
+			error = replace_page_cache_page(pages[replaced], page,
+							GFP_KERNEL);
+			if (error) {
+				__clear_page_locked(page);
+				break;
+			}
+		}
+	}
+
+	/* A partly replaced range stays valid, just not a team */
+	for (i = 0; i < HPAGE_PMD_NR; i++) {
+		if (i < replaced) {
+			lru_cache_add_anon(new + i);
+			unlock_page(new + i);
+		}
+		page_cache_release(new + i);
+	}
+	for (i = 0; i < nr; i++) {
+		unlock_page(pages[i]);
+		page_cache_release(pages[i]);
+	}
+	kfree(pages);
+	return error;
+}
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE */
+
 #ifdef CONFIG_NUMA
 static int shmem_set_policy(struct vm_area_struct *vma, struct mempolicy *mpol)
 {
@@ -1113,6 +1565,8 @@ static int shmem_mmap(struct file *file, struct vm_area_struct *vma)
 	file_accessed(file);
 	vma->vm_ops = &shmem_vm_ops;
 	vma->vm_flags |= VM_CAN_NONLINEAR;
+	if (unlikely(khugepaged_enter_vma_merge(vma)))
+		return -ENOMEM;
 	return 0;
 }
 
@@ -2090,6 +2544,18 @@ static int shmem_parse_options(char *options, struct shmem_sb_info *sbinfo,
 		} else if (!strcmp(this_char,"mpol")) {
 			if (mpol_parse_str(value, &sbinfo->mpol, 1))
 				goto bad_val;
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+		} else if (!strcmp(this_char,"huge")) {
+			int huge = shmem_parse_huge(value);
+
+			/* deny and force are for shmem_enabled only */
+			if (huge < 0)
+				goto bad_val;
+			if (!has_transparent_hugepage() &&
+			    huge != SHMEM_HUGE_NEVER)
+				goto bad_val;
+			sbinfo->huge = huge;
+#endif
 		} else {
 			printk(KERN_ERR "tmpfs: Bad mount option %s\n",
 			       this_char);
@@ -2135,6 +2601,7 @@ static int shmem_remount_fs(struct super_block *sb, int *flags, char *data)
 	sbinfo->max_blocks  = config.max_blocks;
 	sbinfo->max_inodes  = config.max_inodes;
 	sbinfo->free_inodes = config.max_inodes - inodes;
+	sbinfo->huge        = config.huge;
 
 	mpol_put(sbinfo->mpol);
 	sbinfo->mpol        = config.mpol;	/* transfers initial ref */
@@ -2158,6 +2625,10 @@ static int shmem_show_options(struct seq_file *seq, struct dentry *root)
 		seq_printf(seq, ",uid=%u", sbinfo->uid);
 	if (sbinfo->gid != 0)
 		seq_printf(seq, ",gid=%u", sbinfo->gid);
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	if (sbinfo->huge)
+		seq_printf(seq, ",huge=%s", shmem_format_huge(sbinfo->huge));
+#endif
 	shmem_show_mpol(seq, sbinfo->mpol);
 	return 0;
 }
@@ -2374,6 +2845,9 @@ static const struct super_operations shmem_ops = {
 
 static const struct vm_operations_struct shmem_vm_ops = {
 	.fault		= shmem_fault,
+#ifdef CONFIG_TRANSPARENT_HUGEPAGE
+	.pmd_fault	= shmem_pmd_fault,
+#endif
 #ifdef CONFIG_NUMA
 	.set_policy     = shmem_set_policy,
 	.get_policy     = shmem_get_policy,
@@ -2431,6 +2905,63 @@ out4:
 	return error;
 }
 
+#if defined(CONFIG_TRANSPARENT_HUGEPAGE) && defined(CONFIG_SYSFS)
+static ssize_t shmem_enabled_show(struct kobject *kobj,
+		struct kobj_attribute *attr, char *buf)
+{
+	int values[] = {
+		SHMEM_HUGE_ALWAYS,
+		SHMEM_HUGE_WITHIN_SIZE,
+		SHMEM_HUGE_ADVISE,
+		SHMEM_HUGE_NEVER,
+		SHMEM_HUGE_DENY,
+		SHMEM_HUGE_FORCE,
+	};
+	int huge = shmem_huge;
+	int i, count;
+
+	if (huge >= 0)
+		huge = SHMEM_SB(shm_mnt->mnt_sb)->huge;
+	for (i = 0, count = 0; i < ARRAY_SIZE(values); i++) {
+		const char *fmt = values[i] == huge ? "[%s] " : "%s ";
+
+		count += sprintf(buf + count, fmt,
+				shmem_format_huge(values[i]));
+	}
+	buf[count - 1] = '\n';
+	return count;
+}
+
+static ssize_t shmem_enabled_store(struct kobject *kobj,
+		struct kobj_attribute *attr, const char *buf, size_t count)
+{
+	char tmp[16];
+	int huge;
+
+	if (count + 1 > sizeof(tmp))
+		return -EINVAL;
+	memcpy(tmp, buf, count);
+	tmp[count] = '\0';
+	if (count && tmp[count - 1] == '\n')
+		tmp[count - 1] = '\0';
+
+	huge = shmem_parse_huge(tmp);
+	if (huge == -EINVAL)
+		return -EINVAL;
+	if (!has_transparent_hugepage() &&
+	    huge != SHMEM_HUGE_NEVER && huge != SHMEM_HUGE_DENY)
+		return -EINVAL;
+
+	shmem_huge = huge;
+	if (huge >= 0)
+		SHMEM_SB(shm_mnt->mnt_sb)->huge = huge;
+	return count;
+}
+
+struct kobj_attribute shmem_enabled_attr =
+	__ATTR(shmem_enabled, 0644, shmem_enabled_show, shmem_enabled_store);
+#endif /* CONFIG_TRANSPARENT_HUGEPAGE && CONFIG_SYSFS */
+
 #else /* !CONFIG_SHMEM */
 
 /*
@@ -2572,6 +3103,8 @@ int shmem_zero_setup(struct vm_area_struct *vma)
 	vma->vm_file = file;
 	vma->vm_ops = &shmem_vm_ops;
 	vma->vm_flags |= VM_CAN_NONLINEAR;
+	if (unlikely(khugepaged_enter_vma_merge(vma)))
+		return -ENOMEM;
 	return 0;
 }
 
@@ -17,6 +17,7 @@
 #include <linux/pagevec.h>
 #include <linux/migrate.h>
 #include <linux/page_cgroup.h>
+#include <linux/log2.h>
 
 #include <asm/pgtable.h>
 
@@ -252,20 +253,81 @@ void free_pages_and_swap_cache(struct page **pages, int nr)
 	}
 }
 
+/*
+ * Per-vma swap readahead state, packed into vma->swap_readahead_info:
+ * the page address of the last swap fault, the size of the readahead
+ * window opened at that fault, and the number of readahead hits since.
+ */
+#define SWAP_RA_WIN_SHIFT	(PAGE_SHIFT / 2)
+#define SWAP_RA_HITS_MASK	((1UL << SWAP_RA_WIN_SHIFT) - 1)
+#define SWAP_RA_HITS_MAX	SWAP_RA_HITS_MASK
+#define SWAP_RA_WIN_MASK	(~PAGE_MASK & ~SWAP_RA_HITS_MASK)
+
+#define SWAP_RA_HITS(v)		((v) & SWAP_RA_HITS_MASK)
+#define SWAP_RA_WIN(v)		(((v) & SWAP_RA_WIN_MASK) >> SWAP_RA_WIN_SHIFT)
+#define SWAP_RA_ADDR(v)		((v) & PAGE_MASK)
+
+#define SWAP_RA_VAL(addr, win, hits)				\
+	(((addr) & PAGE_MASK) |					\
+	 (((win) << SWAP_RA_WIN_SHIFT) & SWAP_RA_WIN_MASK) |	\
+	 ((hits) & SWAP_RA_HITS_MASK))
+
+/* The window must fit in SWAP_RA_WIN_MASK whatever page_cluster says */
+#define SWAP_RA_ORDER_CEILING	5
+
+int sysctl_swap_vma_readahead __read_mostly = 1;
+
+static void swap_ra_hit(struct vm_area_struct *vma, unsigned long addr)
+{
+	unsigned long ra_val = atomic_long_read(&vma->swap_readahead_info);
+	unsigned long hits = SWAP_RA_HITS(ra_val);
+
+	if (hits < SWAP_RA_HITS_MAX)
+		hits++;
+	atomic_long_set(&vma->swap_readahead_info,
+			SWAP_RA_VAL(addr, SWAP_RA_WIN(ra_val), hits));
+}
+
+/*
+ * A fault satisfied from swap cache without a readahead hit still moves
+ * the fault address on, so the next fault can tell sequential access.
+ */
+static void swap_ra_miss(struct vm_area_struct *vma, unsigned long addr)
+{
+	unsigned long ra_val = atomic_long_read(&vma->swap_readahead_info);
+
+	atomic_long_set(&vma->swap_readahead_info,
+			SWAP_RA_VAL(addr, SWAP_RA_WIN(ra_val),
+				    SWAP_RA_HITS(ra_val)));
+}
+
 /*
  * Lookup a swap entry in the swap cache. A found page will be returned
  * unlocked and with its refcount incremented - we rely on the kernel
  * lock getting page table operations atomic even if we drop the page
  * lock before returning.
+ *
+ * A page brought in by readahead and found here for the first time is
+ * a readahead hit: it is credited to @vma's readahead window, when the
+ * lookup is done on behalf of a fault at @addr in @vma.
  */
-struct page * lookup_swap_cache(swp_entry_t entry)
+struct page *lookup_swap_cache(swp_entry_t entry, struct vm_area_struct *vma,
+			       unsigned long addr)
 {
 	struct page *page;
 
 	page = find_get_page(&swapper_space, entry.val);
 
-	if (page)
+	if (page) {
 		INC_CACHE_INFO(find_success);
+		/* PG_readahead is PG_reclaim while the page is under writeback */
+		if (!PageWriteback(page) && TestClearPageReadahead(page)) {
+			count_vm_event(SWAP_RA_HIT);
+			if (vma)
+				swap_ra_hit(vma, addr);
+		} else if (vma)
+			swap_ra_miss(vma, addr);
+	}
 
 	INC_CACHE_INFO(find_total);
 	return page;
@@ -275,14 +337,17 @@ struct page * lookup_swap_cache(swp_entry_t entry)
  * Locate a page of swap in physical memory, reserving swap cache space
  * and reading the disk if it is not already cached.
  * A failure return means that either the page allocation failed or that
- * the swap entry is no longer in use.
+ * the swap entry is no longer in use.  *@new_page_allocated tells whether
+ * the returned page was newly read in, rather than found in swap cache.
  */
-struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
-			struct vm_area_struct *vma, unsigned long addr)
+static struct page *__read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			bool *new_page_allocated)
 {
 	struct page *found_page, *new_page = NULL;
 	int err;
 
+	*new_page_allocated = false;
 	do {
 		/*
 		 * First check the swap cache.  Since this is normally
@@ -315,6 +380,9 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 		err = swapcache_prepare(entry);
 		if (err == -EEXIST) {	/* seems racy */
 			radix_tree_preload_end();
+			/* Unused entry held by a swap slots cache: give up */
+			if (swap_slot_cached(entry))
+				break;
 			continue;
 		}
 		if (err) {		/* swp entry is obsolete ? */
@@ -333,6 +401,7 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 			 */
 			lru_cache_add_anon(new_page);
 			swap_readpage(new_page);
+			*new_page_allocated = true;
 			return new_page;
 		}
 		radix_tree_preload_end();
@@ -350,6 +419,39 @@ struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
 	return found_page;
 }
 
+struct page *read_swap_cache_async(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr)
+{
+	bool new_page_allocated;
+
+	return __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &new_page_allocated);
+}
+
+/*
+ * Start an asynchronous read of @entry.  If it is read ahead rather than
+ * for the fault itself, mark the page so that its first use can be
+ * recognised as a readahead hit.  Returns false if no page could be had.
+ */
+static bool swap_ra_read(swp_entry_t entry, gfp_t gfp_mask,
+			 struct vm_area_struct *vma, unsigned long addr,
+			 bool readahead)
+{
+	struct page *page;
+	bool new_page_allocated;
+
+	page = __read_swap_cache_async(entry, gfp_mask, vma, addr,
+				       &new_page_allocated);
+	if (!page)
+		return false;
+	if (new_page_allocated && readahead) {
+		SetPageReadahead(page);
+		count_vm_event(SWAP_RA);
+	}
+	page_cache_release(page);
+	return true;
+}
+
 /**
  * swapin_readahead - swap in pages in hope we need them soon
  * @entry: swap entry of this memory
@@ -373,7 +475,6 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 			struct vm_area_struct *vma, unsigned long addr)
 {
 	int nr_pages;
-	struct page *page;
 	unsigned long offset;
 	unsigned long end_offset;
 
@@ -387,12 +488,122 @@ struct page *swapin_readahead(swp_entry_t entry, gfp_t gfp_mask,
 	nr_pages = valid_swaphandles(entry, &offset);
 	for (end_offset = offset + nr_pages; offset < end_offset; offset++) {
 		/* Ok, do the async read-ahead now */
-		page = read_swap_cache_async(swp_entry(swp_type(entry), offset),
-						gfp_mask, vma, addr);
-		if (!page)
+		if (!swap_ra_read(swp_entry(swp_type(entry), offset), gfp_mask,
+				  vma, addr, offset != swp_offset(entry)))
 			break;
-		page_cache_release(page);
 	}
 	lru_add_drain();	/* Push any new pages onto the LRU now */
 	return read_swap_cache_async(entry, gfp_mask, vma, addr);
 }
+
+/*
+ * Size the next readahead window from the previous one: grow it with the
+ * hits the previous window got, open a minimal one for a fault next to
+ * the previous fault, and otherwise read nothing ahead.  The window only
+ * decays by half per fault, so one stray fault doesn't kill it.
+ */
+static unsigned int swap_ra_window(unsigned long prev_pfn, unsigned long pfn,
+				   unsigned int hits, unsigned int max_win,
+				   unsigned int prev_win)
+{
+	unsigned int win = hits + 2;
+
+	if (win == 2) {
+		if (pfn != prev_pfn + 1 && pfn != prev_pfn - 1)
+			win = 1;
+	} else
+		win = roundup_pow_of_two(max(win, 4U));
+
+	win = min(win, max_win);
+	return max(win, prev_win / 2);
+}
+
+/**
+ * swapin_vma_readahead - swap in pages around a faulting address
+ * @entry: swap entry of the faulting pte
+ * @gfp_mask: memory allocation flags
+ * @vma: user vma the faulting address belongs to
+ * @addr: faulting address
+ * @pmd: pmd mapping the page table of the faulting pte
+ *
+ * Returns the struct page for entry and addr, after queueing swapin.
+ *
+ * Unlike swapin_readahead(), which reads the neighbours of @entry in the
+ * swap area, this reads the swapped-out neighbours of @addr in @vma: once
+ * the swap area gets fragmented, neighbouring swap slots need not belong
+ * to the same process at all, while neighbouring virtual pages are what
+ * a sequential or clustered access will fault on next.  The window grows
+ * and shrinks per vma with the hits its readahead pages get, and follows
+ * the direction of the faults.
+ *
+ * Caller must hold down_read on the vma->vm_mm.
+ */
+struct page *swapin_vma_readahead(swp_entry_t entry, gfp_t gfp_mask,
+			struct vm_area_struct *vma, unsigned long addr,
+			pmd_t *pmd)
+{
+	unsigned long ra_val, prev_pfn, pfn, start, end, left;
+	unsigned long pmd_start, pmd_end;
+	unsigned int win, max_win;
+	pte_t ptes[1 << SWAP_RA_ORDER_CEILING];
+	pte_t *pte;
+	int i, nr;
+
+	if (!sysctl_swap_vma_readahead)
+		return swapin_readahead(entry, gfp_mask, vma, addr);
+
+	max_win = 1 << min_t(unsigned int, ACCESS_ONCE(page_cluster),
+			     SWAP_RA_ORDER_CEILING);
+	addr &= PAGE_MASK;
+	pfn = addr >> PAGE_SHIFT;
+	ra_val = atomic_long_read(&vma->swap_readahead_info);
+	prev_pfn = SWAP_RA_ADDR(ra_val) >> PAGE_SHIFT;
+	win = swap_ra_window(prev_pfn, pfn, SWAP_RA_HITS(ra_val), max_win,
+			     SWAP_RA_WIN(ra_val));
+	atomic_long_set(&vma->swap_readahead_info, SWAP_RA_VAL(addr, win, 0));
+	if (win == 1)
+		goto skip;
+
+	/* Read ahead in the direction of the faults, or around the fault */
+	if (pfn == prev_pfn + 1)
+		left = 0;
+	else if (pfn == prev_pfn - 1)
+		left = win - 1;
+	else
+		left = (win - 1) / 2;
+
+	/* Stay within the vma and the page table of the faulting pte */
+	pmd_start = addr & PMD_MASK;
+	pmd_end = pmd_start + PMD_SIZE;
+	start = max3(addr - min(left << PAGE_SHIFT, addr - pmd_start),
+		     vma->vm_start, pmd_start);
+	end = min3(start + ((unsigned long)win << PAGE_SHIFT),
+		   vma->vm_end, pmd_end);
+	nr = (end - start) >> PAGE_SHIFT;
+
+	/*
+	 * Copy the ptes: the page table cannot be freed under mmap_sem, but
+	 * it must not stay mapped across the reads, which may sleep.  Races
+	 * with concurrent faults are harmless, a stale swap entry is simply
+	 * refused by swapcache_prepare().
+	 */
+	pte = pte_offset_map(pmd, start);
+	for (i = 0; i < nr; i++)
+		ptes[i] = pte[i];
+	pte_unmap(pte);
+
+	for (i = 0; i < nr; i++, start += PAGE_SIZE) {
+		swp_entry_t swp;
+
+		if (pte_none(ptes[i]) || pte_present(ptes[i]) ||
+		    pte_file(ptes[i]))
+			continue;
+		swp = pte_to_swp_entry(ptes[i]);
+		if (unlikely(non_swap_entry(swp)))
+			continue;
+		swap_ra_read(swp, gfp_mask, vma, start, start != addr);
+	}
+	lru_add_drain();	/* Push any new pages onto the LRU now */
+skip:
+	return read_swap_cache_async(entry, gfp_mask, vma, addr);
+}
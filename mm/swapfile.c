@@ -31,6 +31,8 @@
 #include <linux/memcontrol.h>
 #include <linux/poll.h>
 #include <linux/oom.h>
+#include <linux/cpu.h>
+#include <linux/percpu.h>
 
 #include <asm/pgtable.h>
 #include <asm/tlbflush.h>
@@ -41,6 +43,8 @@ static bool swap_count_continued(struct swap_info_struct *, pgoff_t,
 				 unsigned char);
 static void free_swap_count_continuations(struct swap_info_struct *);
 static sector_t map_swap_entry(swp_entry_t, struct block_device**);
+static unsigned char swap_entry_free(struct swap_info_struct *,
+				     swp_entry_t, unsigned char);
 
 static DEFINE_SPINLOCK(swap_lock);
 static unsigned int nr_swapfiles;
@@ -408,17 +412,26 @@ no_page:
 	return 0;
 }
 
-swp_entry_t get_swap_page(void)
+/*
+ * Allocate up to @n swap entries for the swap cache into @entries, all
+ * from one swap device, holding swap_lock across the lot.  Consecutive
+ * scan_swap_map() calls hand out consecutive slots of the current
+ * cluster, so a batch is usually one contiguous run on the device.
+ * Returns the number of entries allocated.
+ */
+static int get_swap_pages(int n, swp_entry_t entries[])
 {
 	struct swap_info_struct *si;
 	pgoff_t offset;
 	int type, next;
 	int wrapped = 0;
+	int nr;
 
 	spin_lock(&swap_lock);
 	if (nr_swap_pages <= 0)
 		goto noswap;
-	nr_swap_pages--;
+	n = min_t(long, n, nr_swap_pages);
+	nr_swap_pages -= n;
 
 	for (type = swap_list.next; type >= 0 && wrapped < 2; type = next) {
 		si = swap_info[type];
@@ -435,21 +448,220 @@ swp_entry_t get_swap_page(void)
 			continue;
 
 		swap_list.next = next;
-		/* This is called for allocating swap entry for cache */
-		offset = scan_swap_map(si, SWAP_HAS_CACHE);
-		if (offset) {
+		for (nr = 0; nr < n; nr++) {
+			/* This is called for allocating swap entry for cache */
+			offset = scan_swap_map(si, SWAP_HAS_CACHE);
+			if (!offset)
+				break;
+			entries[nr] = swp_entry(type, offset);
+		}
+		if (nr) {
+			nr_swap_pages += n - nr;
 			spin_unlock(&swap_lock);
-			return swp_entry(type, offset);
+			return nr;
 		}
 		next = swap_list.next;
 	}
 
-	nr_swap_pages++;
+	nr_swap_pages += n;
 noswap:
 	spin_unlock(&swap_lock);
+	return 0;
+}
+
+/*
+ * Swap slots caches: on many-core machines swapping to fast devices,
+ * swap_lock is hammered by allocating and freeing swap entries one at a
+ * time.  Each cpu instead keeps a batch of entries allocated in one go by
+ * get_swap_pages(), and a batch of entries waiting to be freed together.
+ * Entries in either batch have SWAP_HAS_CACHE set in the swap_map, but no
+ * swap count and no page in the swap cache.
+ *
+ * swapoff disables the caches while it runs, draining every cpu's
+ * entries back, so that try_to_unuse() never waits on a cached entry.
+ */
+#define SWAP_SLOTS_CACHE_SIZE	64
+
+struct swap_slots_cache {
+	struct mutex	alloc_lock;	/* protects slots, cur, nr */
+	swp_entry_t	slots[SWAP_SLOTS_CACHE_SIZE];
+	int		cur;
+	int		nr;
+	spinlock_t	free_lock;	/* protects slots_ret, n_ret */
+	swp_entry_t	slots_ret[SWAP_SLOTS_CACHE_SIZE];
+	int		n_ret;
+};
+
+static DEFINE_PER_CPU(struct swap_slots_cache, swp_slots);
+static bool swap_slot_cache_enabled __read_mostly;
+static int swap_slot_cache_disabled = 1;	/* until swap_slots_init() */
+static DEFINE_MUTEX(swap_slots_cache_mutex);
+
+/*
+ * Free a batch of entries which have nothing but SWAP_HAS_CACHE left.
+ */
+static void swapcache_free_entries(swp_entry_t *entries, int n)
+{
+	int i;
+
+	spin_lock(&swap_lock);
+	for (i = 0; i < n; i++) {
+		struct swap_info_struct *p = swap_info[swp_type(entries[i])];
+
+		swap_entry_free(p, entries[i], SWAP_HAS_CACHE);
+	}
+	spin_unlock(&swap_lock);
+}
+
+static void drain_swap_slots_cache(unsigned int cpu)
+{
+	struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+	mutex_lock(&cache->alloc_lock);
+	if (cache->nr) {
+		swapcache_free_entries(cache->slots + cache->cur, cache->nr);
+		cache->nr = 0;
+	}
+	mutex_unlock(&cache->alloc_lock);
+
+	spin_lock_irq(&cache->free_lock);
+	if (cache->n_ret) {
+		swapcache_free_entries(cache->slots_ret, cache->n_ret);
+		cache->n_ret = 0;
+	}
+	spin_unlock_irq(&cache->free_lock);
+}
+
+static void disable_swap_slots_cache(void)
+{
+	int cpu;
+
+	mutex_lock(&swap_slots_cache_mutex);
+	swap_slot_cache_disabled++;
+	swap_slot_cache_enabled = false;
+	for_each_possible_cpu(cpu)
+		drain_swap_slots_cache(cpu);
+	mutex_unlock(&swap_slots_cache_mutex);
+}
+
+static void enable_swap_slots_cache(void)
+{
+	mutex_lock(&swap_slots_cache_mutex);
+	if (!--swap_slot_cache_disabled)
+		swap_slot_cache_enabled = true;
+	mutex_unlock(&swap_slots_cache_mutex);
+}
+
+/*
+ * Queue an entry with only SWAP_HAS_CACHE left to be freed in a batch.
+ * Returns false if the caches are disabled and it must be freed now.
+ */
+static bool free_swap_slot(swp_entry_t entry)
+{
+	struct swap_slots_cache *cache;
+	unsigned long flags;
+	bool queued = false;
+
+	cache = &per_cpu(swp_slots, raw_smp_processor_id());
+	spin_lock_irqsave(&cache->free_lock, flags);
+	if (swap_slot_cache_enabled) {
+		if (cache->n_ret == SWAP_SLOTS_CACHE_SIZE) {
+			swapcache_free_entries(cache->slots_ret, cache->n_ret);
+			cache->n_ret = 0;
+		}
+		cache->slots_ret[cache->n_ret++] = entry;
+		queued = true;
+	}
+	spin_unlock_irqrestore(&cache->free_lock, flags);
+	return queued;
+}
+
+/*
+ * Does only the swap cache still hold this entry?  Checked without
+ * swap_lock, by the holder of that last reference.
+ */
+static bool swap_cache_only(swp_entry_t entry)
+{
+	struct swap_info_struct *p;
+
+	if (swp_type(entry) >= nr_swapfiles)
+		return false;
+	p = swap_info[swp_type(entry)];
+	return (p->flags & SWP_WRITEOK) && swp_offset(entry) < p->max &&
+		p->swap_map[swp_offset(entry)] == SWAP_HAS_CACHE;
+}
+
+/*
+ * Is this entry, found busy by swapcache_prepare(), just sitting in a swap
+ * slots cache?  Then it is not about to be added to the swap cache, and
+ * read_swap_cache_async() must not wait for that.
+ */
+bool swap_slot_cached(swp_entry_t entry)
+{
+	struct swap_info_struct *si = swap_info[swp_type(entry)];
+
+	return swap_slot_cache_enabled &&
+		!swap_count(si->swap_map[swp_offset(entry)]);
+}
+
+swp_entry_t get_swap_page(void)
+{
+	struct swap_slots_cache *cache;
+	swp_entry_t entry;
+
+	/*
+	 * Leave the last few free entries to be allocated one at a time,
+	 * rather than have them stranded in other cpus' caches.
+	 */
+	if (swap_slot_cache_enabled &&
+	    nr_swap_pages > SWAP_SLOTS_CACHE_SIZE * num_online_cpus()) {
+		cache = &per_cpu(swp_slots, raw_smp_processor_id());
+		mutex_lock(&cache->alloc_lock);
+		if (swap_slot_cache_enabled) {
+			if (!cache->nr) {
+				cache->cur = 0;
+				cache->nr = get_swap_pages(SWAP_SLOTS_CACHE_SIZE,
+							   cache->slots);
+			}
+			if (cache->nr) {
+				entry = cache->slots[cache->cur++];
+				cache->nr--;
+				mutex_unlock(&cache->alloc_lock);
+				return entry;
+			}
+		}
+		mutex_unlock(&cache->alloc_lock);
+	}
+
+	if (get_swap_pages(1, &entry))
+		return entry;
 	return (swp_entry_t) {0};
 }
 
+static int __cpuinit swap_slots_cpu_callback(struct notifier_block *nfb,
+					     unsigned long action, void *hcpu)
+{
+	if (action == CPU_DEAD || action == CPU_DEAD_FROZEN)
+		drain_swap_slots_cache((long)hcpu);
+	return NOTIFY_OK;
+}
+
+static int __init swap_slots_init(void)
+{
+	int cpu;
+
+	for_each_possible_cpu(cpu) {
+		struct swap_slots_cache *cache = &per_cpu(swp_slots, cpu);
+
+		mutex_init(&cache->alloc_lock);
+		spin_lock_init(&cache->free_lock);
+	}
+	hotcpu_notifier(swap_slots_cpu_callback, 0);
+	enable_swap_slots_cache();
+	return 0;
+}
+__initcall(swap_slots_init);
+
 /* The only caller of this function is now susupend routine */
 swp_entry_t get_swap_page_of_type(int type)
 {
@@ -587,6 +799,18 @@ void swapcache_free(swp_entry_t entry, struct page *page)
 	struct swap_info_struct *p;
 	unsigned char count;
 
+	/*
+	 * If the swap cache holds the last reference, nothing can take a
+	 * new one now (swap_duplicate needs a pte already pointing to it),
+	 * so the final free can wait for a batch.
+	 */
+	if (swap_slot_cache_enabled && swap_cache_only(entry) &&
+	    free_swap_slot(entry)) {
+		if (page)
+			mem_cgroup_uncharge_swapcache(page, entry, false);
+		return;
+	}
+
 	p = swap_info_get(entry);
 	if (p) {
 		count = swap_entry_free(p, entry, SWAP_HAS_CACHE);
@@ -1615,10 +1839,15 @@ SYSCALL_DEFINE1(swapoff, const char __user *, specialfile)
 	p->flags &= ~SWP_WRITEOK;
 	spin_unlock(&swap_lock);
 
+	/* No entries may hide in the swap slots caches from try_to_unuse */
+	disable_swap_slots_cache();
+
 	oom_score_adj = test_set_oom_score_adj(OOM_SCORE_ADJ_MAX);
 	err = try_to_unuse(type);
 	compare_swap_oom_score_adj(OOM_SCORE_ADJ_MAX, oom_score_adj);
 
+	enable_swap_slots_cache();
+
 	if (err) {
 		/*
 		 * reading p->prio and p->swap_map outside the lock is
@@ -254,6 +254,7 @@ struct vmap_area {
 	unsigned long va_end;
 	unsigned long flags;
 	struct rb_node rb_node;		/* address sorted rbtree */
+	unsigned long subtree_max_gap;	/* largest free gap in subtree */
 	struct list_head list;		/* address sorted list */
 	struct list_head purge_list;	/* "lazy purge" list */
 	struct vm_struct *vm;
@@ -264,14 +265,55 @@ static DEFINE_SPINLOCK(vmap_area_lock);
 static LIST_HEAD(vmap_area_list);
 static struct rb_root vmap_area_root = RB_ROOT;
 
-/* The vmap cache globals are protected by vmap_area_lock */
-static struct rb_node *free_vmap_cache;
-static unsigned long cached_hole_size;
-static unsigned long cached_vstart;
-static unsigned long cached_align;
-
 static unsigned long vmap_area_pcpu_hole;
 
+/*
+ * vmap_area_root is augmented with the size of the largest free gap below
+ * each area in its subtree, where the gap below an area runs from the end
+ * of the previous area (or 0) to the start of that area.  That lets
+ * alloc_vmap_area() find the lowest suitable hole in O(log n), skipping
+ * whole subtrees which cannot hold it.  The address sorted vmap_area_list
+ * gives each area's predecessor, so it must be updated before the gaps.
+ */
+static unsigned long va_gap_start(struct vmap_area *va)
+{
+	struct vmap_area *prev;
+
+	if (va->list.prev == &vmap_area_list)
+		return 0;
+	prev = list_entry(va->list.prev, struct vmap_area, list);
+	return prev->va_end;
+}
+
+static inline unsigned long va_subtree_max_gap(struct rb_node *node)
+{
+	if (!node)
+		return 0;
+	return rb_entry(node, struct vmap_area, rb_node)->subtree_max_gap;
+}
+
+static void vmap_area_augment_cb(struct rb_node *node, void *unused)
+{
+	struct vmap_area *va = rb_entry(node, struct vmap_area, rb_node);
+	unsigned long max_gap = va->va_start - va_gap_start(va);
+
+	max_gap = max(max_gap, va_subtree_max_gap(node->rb_left));
+	max_gap = max(max_gap, va_subtree_max_gap(node->rb_right));
+	va->subtree_max_gap = max_gap;
+}
+
+/*
+ * The gap below @va changed without the tree changing shape: update the
+ * subtree gaps from @va up to the root.
+ */
+static void vmap_area_gap_update(struct vmap_area *va)
+{
+	struct rb_node *node;
+
+	for (node = &va->rb_node; node; node = rb_parent(node))
+		vmap_area_augment_cb(node, NULL);
+}
+
 static struct vmap_area *__find_vmap_area(unsigned long addr)
 {
 	struct rb_node *n = vmap_area_root.rb_node;
@@ -321,6 +363,96 @@ static void __insert_vmap_area(struct vmap_area *va)
 		list_add_rcu(&va->list, &prev->list);
 	} else
 		list_add_rcu(&va->list, &vmap_area_list);
+
+	rb_augment_insert(&va->rb_node, vmap_area_augment_cb, NULL);
+	/* va now ends the gap below the next area */
+	if (!list_is_last(&va->list, &vmap_area_list))
+		vmap_area_gap_update(list_entry(va->list.next,
+						struct vmap_area, list));
+}
+
+/*
+ * Find the lowest address at which [addr, addr + size) fits in the hole
+ * [start, end) and within [vstart, vend), with the given alignment.
+ * Returns 0 if it does not fit.
+ */
+static unsigned long vmap_hole_fit(unsigned long start, unsigned long end,
+				   unsigned long size, unsigned long align,
+				   unsigned long vstart, unsigned long vend)
+{
+	unsigned long addr;
+
+	start = max(start, vstart);
+	end = min(end, vend);
+	addr = ALIGN(start, align);
+	if (addr < start || addr + size - 1 < addr)
+		return 0;
+	if (addr + size > end)
+		return 0;
+	return addr;
+}
+
+/*
+ * Search vmap_area_root for the lowest hole that fits, descending only
+ * into subtrees whose largest gap is big enough.  Alignment may still
+ * make a big enough gap unusable, in which case the search carries on
+ * in address order.  Returns 0 if no hole below the last area fits.
+ *
+ * This is lowest-address first fit, not best fit: the subtree gaps only
+ * bound the largest hole, so finding the smallest hole that fits would
+ * mean visiting every big enough one.  Packing from the bottom keeps the
+ * free space above the last area in one piece for large requests anyway.
+ */
+static unsigned long find_vmap_lowest_match(unsigned long size,
+				unsigned long align,
+				unsigned long vstart, unsigned long vend)
+{
+	struct rb_node *node = vmap_area_root.rb_node;
+	struct vmap_area *va;
+	unsigned long addr;
+
+	if (!node || va_subtree_max_gap(node) < size)
+		return 0;
+
+	va = rb_entry(node, struct vmap_area, rb_node);
+	while (true) {
+		/* Visit the left subtree if it looks promising */
+		if (va_gap_start(va) > vstart &&
+		    va_subtree_max_gap(va->rb_node.rb_left) >= size) {
+			va = rb_entry(va->rb_node.rb_left,
+				      struct vmap_area, rb_node);
+			continue;
+		}
+check_current:
+		/* Everything from here on lies above vend */
+		if (va_gap_start(va) >= vend)
+			return 0;
+		if (va->va_start - va_gap_start(va) >= size) {
+			addr = vmap_hole_fit(va_gap_start(va), va->va_start,
+					     size, align, vstart, vend);
+			if (addr)
+				return addr;
+		}
+
+		/* Visit the right subtree if it looks promising */
+		if (va_subtree_max_gap(va->rb_node.rb_right) >= size) {
+			va = rb_entry(va->rb_node.rb_right,
+				      struct vmap_area, rb_node);
+			continue;
+		}
+
+		/* Go back up until we arrive from a left child */
+		while (true) {
+			struct rb_node *prev = &va->rb_node;
+
+			node = rb_parent(prev);
+			if (!node)
+				return 0;
+			va = rb_entry(node, struct vmap_area, rb_node);
+			if (prev == node->rb_left)
+				goto check_current;
+		}
+	}
 }
 
 static void purge_vmap_area_lazy(void);
@@ -338,7 +470,7 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 	struct rb_node *n;
 	unsigned long addr;
 	int purged = 0;
-	struct vmap_area *first;
+	struct vmap_area *last;
 
 	BUG_ON(!size);
 	BUG_ON(size & ~PAGE_MASK);
@@ -351,84 +483,21 @@ static struct vmap_area *alloc_vmap_area(unsigned long size,
 
 retry:
 	spin_lock(&vmap_area_lock);
-	/*
-	 * Invalidate cache if we have more permissive parameters.
-	 * cached_hole_size notes the largest hole noticed _below_
-	 * the vmap_area cached in free_vmap_cache: if size fits
-	 * into that hole, we want to scan from vstart to reuse
-	 * the hole instead of allocating above free_vmap_cache.
-	 * Note that __free_vmap_area may update free_vmap_cache
-	 * without updating cached_hole_size or cached_align.
-	 */
-	if (!free_vmap_cache ||
-			size < cached_hole_size ||
-			vstart < cached_vstart ||
-			align < cached_align) {
-nocache:
-		cached_hole_size = 0;
-		free_vmap_cache = NULL;
-	}
-	/* record if we encounter less permissive parameters */
-	cached_vstart = vstart;
-	cached_align = align;
-
-	/* find starting point for our search */
-	if (free_vmap_cache) {
-		first = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-		addr = ALIGN(first->va_end, align);
-		if (addr < vstart)
-			goto nocache;
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-	} else {
-		addr = ALIGN(vstart, align);
-		if (addr + size - 1 < addr)
+	addr = find_vmap_lowest_match(size, align, vstart, vend);
+	if (!addr) {
+		/* Nothing fits below the last area: try above it */
+		n = rb_last(&vmap_area_root);
+		last = n ? rb_entry(n, struct vmap_area, rb_node) : NULL;
+		addr = vmap_hole_fit(last ? last->va_end : 0, vend,
+				     size, align, vstart, vend);
+		if (!addr)
 			goto overflow;
-
-		n = vmap_area_root.rb_node;
-		first = NULL;
-
-		while (n) {
-			struct vmap_area *tmp;
-			tmp = rb_entry(n, struct vmap_area, rb_node);
-			if (tmp->va_end >= addr) {
-				first = tmp;
-				if (tmp->va_start <= addr)
-					break;
-				n = n->rb_left;
-			} else
-				n = n->rb_right;
-		}
-
-		if (!first)
-			goto found;
 	}
 
-	/* from the starting point, walk areas until a suitable hole is found */
-	while (addr + size > first->va_start && addr + size <= vend) {
-		if (addr + cached_hole_size < first->va_start)
-			cached_hole_size = first->va_start - addr;
-		addr = ALIGN(first->va_end, align);
-		if (addr + size - 1 < addr)
-			goto overflow;
-
-		n = rb_next(&first->rb_node);
-		if (n)
-			first = rb_entry(n, struct vmap_area, rb_node);
-		else
-			goto found;
-	}
-
-found:
-	if (addr + size > vend)
-		goto overflow;
-
 	va->va_start = addr;
 	va->va_end = addr + size;
 	va->flags = 0;
 	__insert_vmap_area(va);
-	free_vmap_cache = &va->rb_node;
 	spin_unlock(&vmap_area_lock);
 
 	BUG_ON(va->va_start & (align-1));
@@ -454,26 +523,22 @@ overflow:
 
 static void __free_vmap_area(struct vmap_area *va)
 {
+	struct vmap_area *next = NULL;
+	struct rb_node *deepest;
+
 	BUG_ON(RB_EMPTY_NODE(&va->rb_node));
 
-	if (free_vmap_cache) {
-		if (va->va_end < cached_vstart) {
-			free_vmap_cache = NULL;
-		} else {
-			struct vmap_area *cache;
-			cache = rb_entry(free_vmap_cache, struct vmap_area, rb_node);
-			if (va->va_start <= cache->va_start) {
-				free_vmap_cache = rb_prev(&va->rb_node);
-				/*
-				 * We don't try to update cached_hole_size or
-				 * cached_align, but it won't go very wrong.
-				 */
-			}
-		}
-	}
+	if (!list_is_last(&va->list, &vmap_area_list))
+		next = list_entry(va->list.next, struct vmap_area, list);
+
+	deepest = rb_augment_erase_begin(&va->rb_node);
 	rb_erase(&va->rb_node, &vmap_area_root);
 	RB_CLEAR_NODE(&va->rb_node);
 	list_del_rcu(&va->list);
+	rb_augment_erase_end(deepest, vmap_area_augment_cb, NULL);
+	/* the gap below the next area now extends down over va */
+	if (next)
+		vmap_area_gap_update(next);
 
 	/*
 	 * Track the highest possible candidate for pcpu area
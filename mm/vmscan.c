@@ -536,7 +536,8 @@ static pageout_t pageout(struct page *page, struct address_space *mapping,
  * Same as remove_mapping, but if the page is removed from the mapping, it
  * gets returned with a refcount of 0.
  */
-static int __remove_mapping(struct address_space *mapping, struct page *page)
+static int __remove_mapping(struct address_space *mapping, struct page *page,
+			    bool reclaimed)
 {
 	BUG_ON(!PageLocked(page));
 	BUG_ON(mapping != page_mapping(page));
@@ -582,10 +583,20 @@ static int __remove_mapping(struct address_space *mapping, struct page *page)
 		swapcache_free(swap, page);
 	} else {
 		void (*freepage)(struct page *);
+		void *shadow = NULL;
 
 		freepage = mapping->a_ops->freepage;
-
-		__delete_from_page_cache(page);
+		/*
+		 * Remember a reclaimed page cache page so that its refault
+		 * distance can be measured, see mm/workingset.c.  Only do
+		 * this for mappings embedded in their inode: those are
+		 * guaranteed to go through truncation or end_writeback(),
+		 * which drop the shadow entries again.
+		 */
+		if (reclaimed && page_is_file_cache(page) &&
+		    mapping->host && mapping == &mapping->host->i_data)
+			shadow = workingset_eviction(mapping, page);
+		__delete_from_page_cache(page, shadow);
 		spin_unlock_irq(&mapping->tree_lock);
 		mem_cgroup_uncharge_cache_page(page);
 
@@ -608,7 +619,7 @@ cannot_free:
  */
 int remove_mapping(struct address_space *mapping, struct page *page)
 {
-	if (__remove_mapping(mapping, page)) {
+	if (__remove_mapping(mapping, page, false)) {
 		/*
 		 * Unfreezing the refcount with 1 rather than 2 effectively
 		 * drops the pagecache ref for us without requiring another
@@ -784,6 +795,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		struct address_space *mapping;
 		struct page *page;
 		int may_enter_fs;
+		bool lazyfree;
 
 		cond_resched();
 
@@ -842,8 +854,10 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		/*
 		 * Anonymous process memory has backing store?
 		 * Try to allocate it some swap space here.
+		 * Pages given up with MADV_FREE need none.
 		 */
-		if (PageAnon(page) && !PageSwapCache(page)) {
+		lazyfree = PageAnon(page) && !PageSwapBacked(page);
+		if (PageAnon(page) && !PageSwapCache(page) && !lazyfree) {
 			if (!(sc->gfp_mask & __GFP_IO))
 				goto keep_locked;
 			if (!add_to_swap(page))
@@ -857,9 +871,12 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		 * The page is mapped into the page tables of one or more
 		 * processes. Try to unmap it here.
 		 */
-		if (page_mapped(page) && mapping) {
+		if (page_mapped(page) && (mapping || lazyfree)) {
 			switch (try_to_unmap(page, TTU_UNMAP)) {
 			case SWAP_FAIL:
+				/* Written to since MADV_FREE: keep it */
+				if (lazyfree && PageDirty(page))
+					SetPageSwapBacked(page);
 				goto activate_locked;
 			case SWAP_AGAIN:
 				goto keep_locked;
@@ -870,6 +887,18 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
+		if (lazyfree) {
+			/*
+			 * Follow __remove_mapping(): the page can only go if
+			 * nobody else holds a reference (get_user_pages) and
+			 * can still reach its contents.
+			 */
+			if (page_mapped(page) || !page_freeze_refs(page, 1))
+				goto keep_locked;
+			count_vm_event(PGLAZYFREED);
+			goto free_locked;
+		}
+
 		if (PageDirty(page)) {
 			nr_dirty++;
 
@@ -968,7 +997,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 			}
 		}
 
-		if (!mapping || !__remove_mapping(mapping, page))
+		if (!mapping || !__remove_mapping(mapping, page, true))
 			goto keep_locked;
 
 		/*
@@ -978,6 +1007,7 @@ static unsigned long shrink_page_list(struct list_head *page_list,
 		 * we obviously don't have to worry about waking up a process
 		 * waiting on the page lock, because there are no references.
 		 */
+free_locked:
 		__clear_page_locked(page);
 free_it:
 		nr_reclaimed++;
@@ -2969,6 +2999,14 @@ static void kswapd_try_to_sleep(pg_data_t *pgdat, int order, int classzone_idx)
 		 * them before going back to sleep.
 		 */
 		set_pgdat_percpu_threshold(pgdat, calculate_normal_threshold);
+
+		/*
+		 * Reclaim is done: have kcompactd turn the memory it freed
+		 * into the high-order blocks it was freed for, instead of
+		 * leaving that to the next allocations' direct compaction.
+		 */
+		wakeup_kcompactd(pgdat, order, classzone_idx);
+
 		schedule();
 		set_pgdat_percpu_threshold(pgdat, calculate_pressure_threshold);
 	} else {
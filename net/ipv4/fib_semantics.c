@@ -180,6 +180,10 @@ void fib_release_info(struct fib_info *fi)
 			hlist_del(&nexthop_nh->nh_hash);
 		} endfor_nexthops(fi)
 		fi->fib_dead = 1;
+		/* after fib_dead, see rt_cache_route() */
+		change_nexthops(fi) {
+			rt_flush_nexthop(nexthop_nh);
+		} endfor_nexthops(fi)
 		fib_info_put(fi);
 	}
 	spin_unlock_bh(&fib_info_lock);
@@ -75,6 +75,7 @@
 #include <linux/string.h>
 #include <linux/netfilter_ipv4.h>
 #include <linux/slab.h>
+#include <linux/hash.h>
 #include <net/snmp.h>
 #include <net/ip.h>
 #include <net/route.h>
@@ -229,6 +230,20 @@ static inline void icmp_xmit_unlock(struct sock *sk)
 	spin_unlock_bh(&sk->sk_lock.slock);
 }
 
+/*
+ *	Destinations reached through a shared route have no peer to keep
+ *	rate limit state in, and creating one per message would let a flood
+ *	from many sources fill the peer tree.  They use a fixed table of
+ *	buckets hashed by destination instead, updated without locking just
+ *	like the peer fields.
+ */
+#define ICMP_XRLIM_HASH_BITS	10
+
+static struct icmp_xrlim_bucket {
+	u32		rate_tokens;
+	unsigned long	rate_last;
+} icmp_xrlim_buckets[1 << ICMP_XRLIM_HASH_BITS];
+
 /*
  *	Send an ICMP frame.
  */
@@ -252,10 +267,20 @@ static inline bool icmpv4_xrlim_allow(struct net *net, struct rtable *rt,
 
 	/* Limit if icmp type is enabled in ratemask. */
 	if ((1 << type) & net->ipv4.sysctl_icmp_ratemask) {
-		if (!rt->peer)
-			rt_bind_peer(rt, fl4->daddr, 1);
-		rc = inet_peer_xrlim_allow(rt->peer,
-					   net->ipv4.sysctl_icmp_ratelimit);
+		int timeout = net->ipv4.sysctl_icmp_ratelimit;
+
+		if (dst->flags & DST_NOPEER) {
+			struct icmp_xrlim_bucket *b;
+
+			b = &icmp_xrlim_buckets[hash_32((__force u32)fl4->daddr,
+							ICMP_XRLIM_HASH_BITS)];
+			rc = inet_xrlim_allow(&b->rate_tokens, &b->rate_last,
+					      timeout);
+		} else {
+			if (!rt->peer)
+				rt_bind_peer(rt, fl4->daddr, 1);
+			rc = inet_peer_xrlim_allow(rt->peer, timeout);
+		}
 	}
 out:
 	return rc;
@@ -568,7 +593,7 @@ void icmp_send(struct sk_buff *skb_in, int type, int code, __be32 info)
 		rcu_read_lock();
 		if (rt_is_input_route(rt) &&
 		    net->ipv4.sysctl_icmp_errors_use_inbound_ifaddr)
-			dev = dev_get_by_index_rcu(net, rt->rt_iif);
+			dev = dev_get_by_index_rcu(net, inet_iif(skb_in));
 
 		if (dev)
 			saddr = inet_select_addr(dev, 0, RT_SCOPE_LINK);
@@ -921,12 +946,11 @@ static void icmp_address(struct sk_buff *skb)
 
 static void icmp_address_reply(struct sk_buff *skb)
 {
-	struct rtable *rt = skb_rtable(skb);
 	struct net_device *dev = skb->dev;
 	struct in_device *in_dev;
 	struct in_ifaddr *ifa;
 
-	if (skb->len < 4 || !(rt->rt_flags&RTCF_DIRECTSRC))
+	if (skb->len < 4)
 		return;
 
 	in_dev = __in_dev_get_rcu(dev);
@@ -937,15 +961,19 @@ static void icmp_address_reply(struct sk_buff *skb)
 	    IN_DEV_LOG_MARTIANS(in_dev) &&
 	    IN_DEV_FORWARD(in_dev)) {
 		__be32 _mask, *mp;
+		bool onlink = false;
 
 		mp = skb_header_pointer(skb, 0, sizeof(_mask), &_mask);
 		BUG_ON(mp == NULL);
+		/* Only replies from directly connected hosts are checked. */
 		for (ifa = in_dev->ifa_list; ifa; ifa = ifa->ifa_next) {
-			if (*mp == ifa->ifa_mask &&
-			    inet_ifa_match(ip_hdr(skb)->saddr, ifa))
+			if (!inet_ifa_match(ip_hdr(skb)->saddr, ifa))
+				continue;
+			onlink = true;
+			if (*mp == ifa->ifa_mask)
 				break;
 		}
-		if (!ifa && net_ratelimit()) {
+		if (!ifa && onlink && net_ratelimit()) {
 			printk(KERN_INFO "Wrong address mask %pI4 from %s/%pI4\n",
 			       mp, dev->name, &ip_hdr(skb)->saddr);
 		}
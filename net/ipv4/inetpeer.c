@@ -449,7 +449,9 @@ relookup:
 		p->pmtu_orig = 0;
 		p->redirect_genid = 0;
 		memset(&p->redirect_learned, 0, sizeof(p->redirect_learned));
-
+		p->tcp_fastopen_mss = 0;
+		p->tcp_fastopen_syn_loss = 0;
+		p->tcp_fastopen_cookie.len = 0;
 
 		/* Link the node. */
 		link_to_pool(p, base);
@@ -487,25 +489,31 @@ EXPORT_SYMBOL_GPL(inet_putpeer);
  * 	Shared between ICMPv4 and ICMPv6.
  */
 #define XRLIM_BURST_FACTOR 6
-bool inet_peer_xrlim_allow(struct inet_peer *peer, int timeout)
+bool inet_xrlim_allow(u32 *rate_tokens, unsigned long *rate_last, int timeout)
 {
 	unsigned long now, token;
 	bool rc = false;
 
-	if (!peer)
-		return true;
-
-	token = peer->rate_tokens;
+	token = *rate_tokens;
 	now = jiffies;
-	token += now - peer->rate_last;
-	peer->rate_last = now;
+	token += now - *rate_last;
+	*rate_last = now;
 	if (token > XRLIM_BURST_FACTOR * timeout)
 		token = XRLIM_BURST_FACTOR * timeout;
 	if (token >= timeout) {
 		token -= timeout;
 		rc = true;
 	}
-	peer->rate_tokens = token;
+	*rate_tokens = token;
 	return rc;
 }
+EXPORT_SYMBOL(inet_xrlim_allow);
+
+bool inet_peer_xrlim_allow(struct inet_peer *peer, int timeout)
+{
+	if (!peer)
+		return true;
+
+	return inet_xrlim_allow(&peer->rate_tokens, &peer->rate_last, timeout);
+}
 EXPORT_SYMBOL(inet_peer_xrlim_allow);
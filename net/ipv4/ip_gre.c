@@ -730,7 +730,7 @@ static netdev_tx_t ipgre_tunnel_xmit(struct sk_buff *skb, struct net_device *dev
 
 		if (skb->protocol == htons(ETH_P_IP)) {
 			rt = skb_rtable(skb);
-			if ((dst = rt->rt_gateway) == 0)
+			if ((dst = rt_nexthop(rt, old_iph->daddr)) == 0)
 				goto tx_error_icmp;
 		}
 #if IS_ENABLED(CONFIG_IPV6)
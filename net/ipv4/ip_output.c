@@ -215,6 +215,21 @@ static inline int ip_finish_output2(struct sk_buff *skb)
 	}
 	rcu_read_unlock();
 
+	/* The shared route of an on-link nexthop has no neighbour of its
+	 * own, the packet goes to its destination.
+	 */
+	if (!rt->rt_gateway) {
+		__be32 nexthop = rt_nexthop(rt, ip_hdr(skb)->daddr);
+		int res;
+
+		neigh = dst_neigh_lookup(dst, &nexthop);
+		if (!IS_ERR(neigh)) {
+			res = neigh_output(neigh, skb);
+			neigh_release(neigh);
+			return res;
+		}
+	}
+
 	if (net_ratelimit())
 		printk(KERN_DEBUG "ip_finish_output2: No header cache and no neighbour!\n");
 	kfree_skb(skb);
@@ -381,7 +396,8 @@ int ip_queue_xmit(struct sk_buff *skb, struct flowi *fl)
 	skb_dst_set_noref(skb, &rt->dst);
 
 packet_routed:
-	if (inet_opt && inet_opt->opt.is_strictroute && fl4->daddr != rt->rt_gateway)
+	if (inet_opt && inet_opt->opt.is_strictroute &&
+	    rt_nexthop(rt, fl4->daddr) != fl4->daddr)
 		goto no_route;
 
 	/* OK, we know where to send it, allocate and build IP header. */
@@ -989,7 +989,7 @@ e_inval:
  * @sk: socket
  * @skb: buffer
  *
- * To support IP_CMSG_PKTINFO option, we store rt_iif and rt_spec_dst
+ * To support IP_CMSG_PKTINFO option, we store inet_iif() and rt_spec_dst
  * in skb->cb[] before dst drop.
  * This way, receiver doesnt make cache line misses to read rtable.
  */
@@ -999,7 +999,7 @@ void ipv4_pktinfo_prepare(struct sk_buff *skb)
 	const struct rtable *rt = skb_rtable(skb);
 
 	if (rt) {
-		pktinfo->ipi_ifindex = rt->rt_iif;
+		pktinfo->ipi_ifindex = inet_iif(skb);
 		pktinfo->ipi_spec_dst.s_addr = rt->rt_spec_dst;
 	} else {
 		pktinfo->ipi_ifindex = 0;
@@ -454,7 +454,7 @@ static netdev_tx_t ipip_tunnel_xmit(struct sk_buff *skb, struct net_device *dev)
 			dev->stats.tx_fifo_errors++;
 			goto tx_error;
 		}
-		if ((dst = rt->rt_gateway) == 0)
+		if ((dst = rt_nexthop(rt, old_iph->daddr)) == 0)
 			goto tx_error_icmp;
 	}
 
@@ -18,10 +18,12 @@
 #include <linux/netdevice.h>
 #include <linux/init.h>
 #include <linux/skbuff.h>
+#include <linux/ip.h>
 #include <linux/moduleparam.h>
 #include <net/dst.h>
 #include <net/neighbour.h>
 #include <net/pkt_sched.h>
+#include <net/route.h>
 
 /*
    How to setup it.
@@ -278,9 +280,25 @@ static inline int teql_resolve(struct sk_buff *skb,
 
 	rcu_read_lock();
 	mn = dst_get_neighbour_noref(dst);
-	res = mn ? __teql_resolve(skb, skb_res, dev, txq, mn) : 0;
+	if (mn) {
+		res = __teql_resolve(skb, skb_res, dev, txq, mn);
+		rcu_read_unlock();
+		return res;
+	}
 	rcu_read_unlock();
 
+	res = 0;
+	if (skb->protocol == htons(ETH_P_IP)) {
+		/* shared route of an on-link nexthop */
+		__be32 nexthop = rt_nexthop((struct rtable *)dst,
+					    ip_hdr(skb)->daddr);
+
+		mn = dst_neigh_lookup(dst, &nexthop);
+		if (IS_ERR(mn))
+			return PTR_ERR(mn);
+		res = __teql_resolve(skb, skb_res, dev, txq, mn);
+		neigh_release(mn);
+	}
 	return res;
 }
 
@@ -599,21 +599,33 @@ int svc_recv(struct svc_rqst *rqstp, long timeout)
 			"svc_recv: service %p, wait queue active!\n",
 			 rqstp);
 
-	/* now allocate needed pages.  If we get a failure, sleep briefly */
+	/*
+	 * now allocate needed pages, each run of missing ones in a single
+	 * bulk allocation.  If we get a failure, sleep briefly
+	 */
 	pages = (serv->sv_max_mesg + PAGE_SIZE) / PAGE_SIZE;
-	for (i = 0; i < pages ; i++)
-		while (rqstp->rq_pages[i] == NULL) {
-			struct page *p = alloc_page(GFP_KERNEL);
-			if (!p) {
-				set_current_state(TASK_INTERRUPTIBLE);
-				if (signalled() || kthread_should_stop()) {
-					set_current_state(TASK_RUNNING);
-					return -EINTR;
-				}
-				schedule_timeout(msecs_to_jiffies(500));
+	i = 0;
+	while (i < pages) {
+		unsigned long want, got;
+
+		if (rqstp->rq_pages[i]) {
+			i++;
+			continue;
+		}
+		for (want = 1; i + want < pages; want++)
+			if (rqstp->rq_pages[i + want])
+				break;
+		got = alloc_pages_bulk(GFP_KERNEL, want, &rqstp->rq_pages[i]);
+		i += got;
+		if (got < want) {
+			set_current_state(TASK_INTERRUPTIBLE);
+			if (signalled() || kthread_should_stop()) {
+				set_current_state(TASK_RUNNING);
+				return -EINTR;
 			}
-			rqstp->rq_pages[i] = p;
+			schedule_timeout(msecs_to_jiffies(500));
 		}
+	}
 	rqstp->rq_pages[i++] = NULL; /* this might be seen in nfs_read_actor */
 	BUG_ON(pages >= RPCSVC_MAXPAGES);
 